@@ -73,15 +73,16 @@ struct WhileAnalysisInterface
 
       D bbIn(join(bb));
 
-      for(const WhileInstr &i : bb->Body)
-        bbIn = transf(i, bbIn);
+      for(const WhileInstr *i : bb->Body)
+        bbIn = transf(*i, bbIn);
 
       D &bbOut = BBOut[bb];
       if (bbIn != bbOut)
       {
         bbOut = bbIn;
-        for(const auto &[kind, succ] : bb->Succ)
-          WorkList.emplace(succ);
+        for(const WhileBlock *succ : bb->Succ)
+          if (succ)
+            WorkList.emplace(succ);
       }
     }
   }
@@ -93,19 +94,19 @@ struct WhileAnalysisInterface
       f.dumphead(s);
       dump_entry(s, f);
 
-      for(const WhileBlock &bb : f.Body)
+      for(const WhileBlock *bb : f.Body)
       {
-        D bbIn(join(&bb));
+        D bbIn(join(bb));
 
-        bb.dumphead(s) << "\n";
+        bb->dumphead(s) << "\n";
 
         dump_first(s, bbIn);
-        for (const WhileInstr &i : bb.Body)
+        for (const WhileInstr *i : bb->Body)
         {
           dump_pre(s, bbIn);
-          s << std::setw(4) << i.Index << ": ";
-          i.dump(s) << "\n";
-          bbIn = transf(i, bbIn);
+          s << std::setw(4) << i->Index << ": ";
+          i->dump(s) << "\n";
+          bbIn = transf(*i, bbIn);
           dump_post(s, bbIn);
         }
       }
@@ -125,8 +126,8 @@ struct WhileDataFlowAnalysis : public WhileAnalysisInterface<D>
   {
     WorkList.clear();
 
-    for(const WhileBlock &b : f.Body)
-      WorkList.emplace(&b);
+    for(const WhileBlock *b : f.Body)
+      WorkList.emplace(b);
   }
 
   void analyze(const WhileProgram &p)
@@ -210,11 +211,11 @@ struct WhileInterproceduralDataFlowAnalysis : public WhileAnalysisInterface<D>
 
     const auto main = p.Functions.find("main");
     if (main != p.Functions.end())
-      WorkList.emplace(&main->second.Body.front());
+      WorkList.emplace(main->second.Body.front());
     else
     {
       for(const auto &[n, f] : p.Functions)
-        WorkList.emplace(&f.Body.front());
+        WorkList.emplace(f.Body.front());
     }
   }
 
@@ -232,7 +233,7 @@ struct WhileInterproceduralDataFlowAnalysis : public WhileAnalysisInterface<D>
         if (csOut != instrOut)
         {
           csOut = instrOut;
-          WorkList.emplace(&fun->Body.front());
+          WorkList.emplace(fun->Body.front());
 
           // prevent changing BBOut -- WRETURN will update it.
           return BBOut[i.Block];
@@ -249,8 +250,9 @@ struct WhileInterproceduralDataFlowAnalysis : public WhileAnalysisInterface<D>
         if (instrOut != bbOut)
         {
           bbOut = instrOut;
-          for(const auto &[kind, succ] : bb->Succ)
-            WorkList.emplace(succ);
+          for(const WhileBlock *succ : bb->Succ)
+            if (succ)
+              WorkList.emplace(succ);
         }
       }
     }
@@ -269,9 +271,14 @@ struct WhileInterproceduralDataFlowAnalysis : public WhileAnalysisInterface<D>
 struct WhileAnalysis
 {
   const char *Description;
+
+  // Analyses in SSA form are run after all others, once the functions have
+  // been translated into SSA form.
+  bool SSA;
+
   virtual void analyze(const WhileProgram &p) = 0;
 
-  WhileAnalysis(const char *name, const char *descr);
+  WhileAnalysis(const char *name, const char *descr, bool ssa = false);
 };
 
 extern std::map<std::string, WhileAnalysis*> WhileAnalyses;
@@ -0,0 +1,186 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file defines a simple bump-pointer arena, which owns the blocks,
+// instructions, and operands of a While program, and a small growable array
+// that keeps its first elements inline and spills into the arena.
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#pragma once
+
+class WhileArena
+{
+  static constexpr size_t ChunkSize = 64 * 1024;
+
+  std::vector<std::unique_ptr<char[]> > Chunks;
+  char *Current = nullptr;
+  char *End = nullptr;
+  size_t Allocated = 0;
+
+public:
+  WhileArena() = default;
+  WhileArena(const WhileArena &) = delete;
+  WhileArena &operator=(const WhileArena &) = delete;
+
+  void *allocate(size_t size, size_t align)
+  {
+    size_t pad = (align - (reinterpret_cast<size_t>(Current) % align)) % align;
+    if (Current == nullptr || Current + pad + size > End)
+    {
+      size_t chunk = std::max(ChunkSize, size + align);
+      Chunks.emplace_back(new char[chunk]);
+      Current = Chunks.back().get();
+      End = Current + chunk;
+      pad = (align - (reinterpret_cast<size_t>(Current) % align)) % align;
+    }
+
+    char *result = Current + pad;
+    Current = result + size;
+    Allocated += size;
+    return result;
+  }
+
+  // Objects in the arena are never destroyed individually, all memory is
+  // released at once with the arena.
+  template<typename T, typename... Args>
+  T *create(Args&&... args)
+  {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "Arena objects are never destroyed.");
+    return new (allocate(sizeof(T), alignof(T)))
+      T(std::forward<Args>(args)...);
+  }
+
+  template<typename T>
+  T *allocateArray(size_t n)
+  {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "Arena objects are never destroyed.");
+    T *result = static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+    for(size_t i = 0; i < n; i++)
+      new (&result[i]) T();
+    return result;
+  }
+
+  size_t bytesAllocated() const
+  {
+    return Allocated;
+  }
+};
+
+// A growable array whose first N elements are stored inline. Larger arrays
+// are moved to the arena, the old storage is simply abandoned.
+template<typename T, unsigned int N>
+class WhileArenaVector
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Elements are copied using memcpy.");
+
+  T Inline[N];
+  T *Spill = nullptr;
+  unsigned int Size = 0;
+  unsigned int Capacity = N;
+
+  void grow(WhileArena &arena)
+  {
+    T *data = arena.allocateArray<T>(2 * Capacity);
+    std::memcpy(static_cast<void*>(data), begin(), Size * sizeof(T));
+    Spill = data;
+    Capacity *= 2;
+  }
+
+public:
+  typedef T *iterator;
+  typedef const T *const_iterator;
+
+  WhileArenaVector() = default;
+  WhileArenaVector(const WhileArenaVector &) = delete;
+  WhileArenaVector &operator=(const WhileArenaVector &) = delete;
+
+  T *begin()              { return Spill ? Spill : Inline; }
+  T *end()                { return begin() + Size; }
+  const T *begin() const  { return Spill ? Spill : Inline; }
+  const T *end() const    { return begin() + Size; }
+
+  unsigned int size() const { return Size; }
+  bool empty() const        { return Size == 0; }
+
+  T &operator[](unsigned int idx)             { return begin()[idx]; }
+  const T &operator[](unsigned int idx) const { return begin()[idx]; }
+
+  T &front()              { assert(Size); return begin()[0]; }
+  T &back()               { assert(Size); return begin()[Size - 1]; }
+  const T &front() const  { assert(Size); return begin()[0]; }
+  const T &back() const   { assert(Size); return begin()[Size - 1]; }
+
+  void push_back(WhileArena &arena, const T &value)
+  {
+    if (Size == Capacity)
+      grow(arena);
+    begin()[Size++] = value;
+  }
+
+  T *insert(WhileArena &arena, const T *pos, const T &value)
+  {
+    unsigned int idx = pos - begin();
+    assert(idx <= Size);
+    if (Size == Capacity)
+      grow(arena);
+
+    T *data = begin();
+    std::memmove(static_cast<void*>(data + idx + 1), data + idx,
+                 (Size - idx) * sizeof(T));
+    data[idx] = value;
+    Size++;
+    return data + idx;
+  }
+
+  T *erase(const T *pos)
+  {
+    unsigned int idx = pos - begin();
+    assert(idx < Size);
+
+    T *data = begin();
+    std::memmove(static_cast<void*>(data + idx), data + idx + 1,
+                 (Size - idx - 1) * sizeof(T));
+    Size--;
+    return data + idx;
+  }
+
+  void resize(unsigned int size)
+  {
+    assert(size <= Size && "Only shrinking is supported.");
+    Size = size;
+  }
+
+  void clear()
+  {
+    Size = 0;
+  }
+};
@@ -23,9 +23,15 @@
 // 3-address-code-like instructions.
 
 #include "WhileLang.h"
+#include "WhileArena.h"
 
 #include <antlr4-runtime.h>
 
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
 #pragma once
 
 class WhileState;
@@ -59,9 +65,10 @@ struct WhileOperand
   WhileOpKind Kind;
   int ValueOrIndex;
   WhileSymbol *Symbol = nullptr;
-  std::string Comment;
+  const char *Comment = nullptr; // interned, see WhileProgram::intern
 
-  WhileOperand(WhileOpKind kind = WUNKNOWN, int valoridx = 0, const std::string &comment = "")
+  WhileOperand(WhileOpKind kind = WUNKNOWN, int valoridx = 0,
+               const char *comment = nullptr)
     : Kind(kind), ValueOrIndex(valoridx), Comment(comment)
   {
   }
@@ -94,6 +101,33 @@ struct WhileOperand
   std::ostream &dump(std::ostream &s) const;
 };
 
+// A fixed-size array of operands, allocated in the arena of the program.
+struct WhileOperands
+{
+  WhileOperand *Data = nullptr;
+  unsigned int Size = 0;
+
+  WhileOperand *begin()             { return Data; }
+  WhileOperand *end()               { return Data + Size; }
+  const WhileOperand *begin() const { return Data; }
+  const WhileOperand *end() const   { return Data + Size; }
+
+  unsigned int size() const { return Size; }
+  bool empty() const        { return Size == 0; }
+
+  WhileOperand &operator[](unsigned int idx)
+  {
+    assert(idx < Size);
+    return Data[idx];
+  }
+
+  const WhileOperand &operator[](unsigned int idx) const
+  {
+    assert(idx < Size);
+    return Data[idx];
+  }
+};
+
 enum WhileOpcode
 {
   WCALL,      // Ops: Fun Opd = Arg1, Arg2, ... ArgN
@@ -109,9 +143,17 @@ enum WhileOpcode
   WLESSEQUAL, // Ops: OpD = OpA <= OpB
   WBRANCHZ,   // Ops: Cond, BB
   WBRANCH,    // Ops: BB
-  WRETURN     // Ops: VallueToReturn
+  WRETURN,    // Ops: VallueToReturn
+  WPHI        // Ops: OpD = Val1, Val2, ... ValN, one value per predecessor
 };
 
+extern const char *WhileOpcodes[];
+
+// Compute the result of a pure instruction (see WhileInstr::isPure) with the
+// interpreter's semantics. Returns false if the result is undefined, e.g., on
+// division by zero.
+bool evaluateBinary(WhileOpcode opc, int a, int b, int &result);
+
 struct WhileBlock;
 
 struct WhileInstr
@@ -121,19 +163,147 @@ struct WhileInstr
   unsigned int OffsetOnLine;
 
   WhileOpcode Opc;
-  std::vector<WhileOperand> Ops;
+  WhileOperands Ops;
 
   WhileBlock *Block;
 
+  // Loads and stores whose address is known to lie within the globals or the
+  // frame of the function, the interpreter omits the bounds check. Set by the
+  // bounds-check elimination, transformations changing the address or moving
+  // the access to another block have to reset it.
+  bool InBounds = false;
+
+  // Calls whose result is returned right away and whose callee cannot access
+  // the frame of the caller, the interpreter reuses the caller's frame for the
+  // callee. Set by the tail-call elimination, transformations adding code
+  // after the call or taking the address of the frame have to reset it.
+  bool TailCall = false;
+
   WhileInstr(unsigned int idx, unsigned int line, unsigned int offs,
              WhileOpcode opc, WhileBlock *block)
     : Index(idx), Line(line), OffsetOnLine(offs), Opc(opc), Block(block)
   {
   }
 
+  // The operand written by the instruction, or nullptr.
+  const WhileOperand *def() const
+  {
+    switch (Opc)
+    {
+      case WCALL:
+        return &Ops[1];
+      case WLOAD:
+      case WPLUS:
+      case WMINUS:
+      case WMULT:
+      case WDIV:
+      case WEQUAL:
+      case WUNEQUAL:
+      case WLESS:
+      case WLESSEQUAL:
+      case WPHI:
+        return &Ops[0];
+      case WSTORE:
+      case WBRANCHZ:
+      case WBRANCH:
+      case WRETURN:
+        return nullptr;
+    }
+    abort();
+  }
+
+  WhileOperand *def()
+  {
+    return const_cast<WhileOperand*>(
+             static_cast<const WhileInstr*>(this)->def());
+  }
+
+  // Check whether the operand at position idx is read by the instruction.
+  bool isUse(unsigned int idx) const
+  {
+    switch (Opc)
+    {
+      case WCALL:
+        return idx >= 2;
+      case WLOAD:
+      case WPLUS:
+      case WMINUS:
+      case WMULT:
+      case WDIV:
+      case WEQUAL:
+      case WUNEQUAL:
+      case WLESS:
+      case WLESSEQUAL:
+        return idx == 1 || idx == 2;
+      case WSTORE:
+        return true;
+      case WBRANCHZ:
+      case WRETURN:
+        return idx == 0;
+      case WBRANCH:
+        return false;
+      case WPHI:
+        return idx >= 1;
+    }
+    abort();
+  }
+
+  bool isTerminator() const
+  {
+    return Opc == WBRANCHZ || Opc == WBRANCH || Opc == WRETURN;
+  }
+
+  // Instructions without side effects can be removed when their result is not
+  // used.
+  bool hasSideEffects() const
+  {
+    return Opc == WCALL || Opc == WSTORE || isTerminator();
+  }
+
+  // Arithmetic and compare instructions, computing their result from the
+  // operands only.
+  bool isPure() const
+  {
+    return Opc >= WPLUS && Opc <= WLESSEQUAL;
+  }
+
+  // Register-to-register moves, emitted by the code generator as OpD = 0 + OpB.
+  bool isCopy() const
+  {
+    return Opc == WPLUS && Ops[1].isZero() && Ops[2].Kind == WREGISTER;
+  }
+
+  // For a frame pointer operand at position idx, the position of the constant
+  // added to it, i.e., the offset of the accessed frame slot, or -1 if the
+  // instruction uses the frame pointer otherwise.
+  int frameOffset(unsigned int idx) const
+  {
+    int offs = -1;
+    if (Opc == WLOAD && idx == 1)
+      offs = 2;
+    else if (Opc == WSTORE && idx == 0)
+      offs = 1;
+    else if (Opc == WPLUS && idx != 0)
+      offs = 3 - idx;
+
+    return offs >= 0 && Ops[offs].isImm() ? offs : -1;
+  }
+
+  // Check whether the instruction is a call whose result is returned right
+  // away, i.e., it is followed by a return of the call's result, in its block
+  // or, when it ends its block, after falling through over empty blocks.
+  bool inTailPosition() const;
+
   std::ostream &dump(std::ostream &s) const;
 };
 
+// An operand reading a register.
+struct WhileUse
+{
+  WhileInstr *Instr;
+  unsigned int Operand;
+};
+
 struct WhileFunction;
 
 enum WhileSuccKind
@@ -142,60 +312,244 @@ enum WhileSuccKind
   WBRANCH_TAKEN
 };
 
+struct WhileEdge
+{
+  WhileBlock *Block;
+  WhileSuccKind Kind;
+};
+
+typedef WhileArenaVector<WhileInstr*, 4> WhileInstrList;
+typedef WhileArenaVector<WhileEdge, 2> WhileEdgeList;
+
 struct WhileBlock
 {
   unsigned int Index;
-  std::list<WhileInstr> Body;
-  std::map<WhileSuccKind, WhileBlock *> Succ;
-  std::set<std::pair<WhileBlock *, WhileSuccKind> > Pred;
+  WhileInstrList Body;
+  WhileBlock *Succ[2] = {nullptr, nullptr};
+  WhileEdgeList Pred;
   WhileFunction *Function;
 
+  // Phis at the entry of the block, only present in SSA form, see
+  // constructSSA. The operand following the result is the value flowing in
+  // from each predecessor, in the order of Pred. Edges added to the block get
+  // an undefined operand, removed edges drop theirs.
+  WhileInstrList Phis;
+
+  // Number of executions of the block, read from a profile, see readProfile.
+  unsigned long Count = 0;
+
+  // Number of times the branch ending the block was taken, from the profile.
+  unsigned long TakenCount = 0;
+
   bool isEntry() const
   {
     return Index == 0;
   }
 
+  // Number of executions of the edge to the successor of the given kind,
+  // derived from the profile.
+  unsigned long edgeCount(WhileSuccKind kind) const
+  {
+    if (!Succ[kind])
+      return 0;
+    else if (kind == WBRANCH_TAKEN)
+      return TakenCount;
+
+    return Count - std::min(Count, TakenCount);
+  }
+
   WhileBlock(unsigned int idx, WhileFunction *function)
     : Index(idx), Function(function)
   {
   }
 
+  WhileArena &arena() const;
+
+  // Allocate a new instruction with room for numops operands, the instruction
+  // is not yet inserted into the block.
+  WhileInstr *createInstr(unsigned int line, unsigned int offs,
+                          WhileOpcode opc, unsigned int numops);
+
+  // Allocate a move OpD = 0 + Val at the source location of instr, the move is
+  // not yet inserted into the block.
+  WhileInstr *createMove(const WhileInstr &instr, const WhileOperand &dst,
+                         const WhileOperand &val);
+
+  WhileInstr &append(WhileInstr *i);
+
+  // Create a phi defining the register at the end of the phis of the block,
+  // its operands are undefined.
+  WhileInstr *createPhi(const WhileOperand &def);
+
+  // Insert an instruction at position idx and renumber the instructions
+  // following it. Calls are added to the call sites of their callee.
+  WhileInstr &insert(unsigned int idx, WhileInstr *i);
+
+  // Remove the instruction at position idx and renumber the instructions
+  // following it. Calls are removed from the call sites of their callee.
+  void erase(unsigned int idx);
+
+  // Replace the instruction at position idx, keeping call sites up-to-date.
+  void replace(unsigned int idx, WhileInstr *i);
+
+  void addEdge(WhileSuccKind kind, WhileBlock *succ);
+  void removeEdge(WhileSuccKind kind);
+
+  // Change the target of an edge, the operand of a branch is updated.
+  void redirectEdge(WhileSuccKind kind, WhileBlock *succ);
+
   std::ostream &dumpshort(std::ostream &s) const;
   std::ostream &dumphead(std::ostream &s) const;
   std::ostream &dump(std::ostream &s) const;
 };
 
-class WhileProgram;
+struct WhileProgram;
+struct WhileDominatorTree;
+struct WhileDominanceFrontiers;
+struct WhileLoopForest;
+struct WhileDefUse;
+
+// A variable living in the frame of a function, i.e., an array or an
+// address-taken variable, occupying Size slots from FP + Offset.
+struct WhileFrameObject
+{
+  unsigned int Offset;
+  unsigned int Size;
+  WhileSymbol *Symbol;
+};
+
+// An analysis of the control-flow graph cached on a function, it is recomputed
+// when the graph was modified since it was computed.
+template<typename T>
+struct WhileCachedAnalysis
+{
+  std::shared_ptr<const T> Result;
+  unsigned int Version = 0;
+};
 
 struct WhileFunction
 {
   unsigned int Index;
   std::string Name;
-  std::list<WhileBlock> Body;
+  std::vector<WhileBlock*> Body;
   std::map<std::string, WhileSymbol*> Locals;
-  std::map<WhileSymbol*, WhileOperand> Registers;
+  std::unordered_map<WhileSymbol*, WhileOperand> Registers;
+  unsigned int NumRegisters = 0;
   unsigned int FrameSize = 0;
-  std::list<WhileInstr*> CallSites;
+  std::vector<WhileInstr*> CallSites;
+
+  // The register receiving each argument of a call, or -1 for parameters passed
+  // in memory, i.e., address-taken parameters stored at FP + idx.
+  std::vector<int> ParameterRegisters;
+
+  // The variables in the frame, including those of inlined functions. Slots of
+  // variables in registers are not used.
+  std::vector<WhileFrameObject> FrameObjects;
   WhileProgram *Program;
 
+  // Incremented whenever blocks or edges are added, removed, or renumbered.
+  unsigned int CFGVersion = 0;
+
+  // Incremented whenever instructions are added or removed, and with the
+  // control-flow graph. Transformations modifying the operands of instructions
+  // in place have to call invalidateCode.
+  unsigned int CodeVersion = 0;
+
   WhileFunction(std::string name, unsigned int idx, WhileProgram *p)
       : Index(idx), Name(name), Program(p)
   {
   }
 
+  WhileBlock *createBlock();
+
+  // Create an empty block placed before bb, the blocks are renumbered.
+  WhileBlock *createBlockBefore(WhileBlock *bb);
+
+  // Remove the blocks for which keep is false, along with their instructions
+  // and edges, then renumber the remaining blocks.
+  void removeBlocks(const std::vector<bool> &keep);
+
+  // Restore consecutive block and instruction indices after blocks were
+  // removed or reordered, branch operands are updated to match the successors.
+  void renumber();
+
+  // The number of instructions of the function, phis are not counted.
+  unsigned int size() const;
+
+  // Check whether the address of the frame may be held in registers or memory,
+  // i.e., the frame pointer is used other than as the address of loads and
+  // stores.
+  bool frameEscapes() const;
+
+  // Check whether the function is in SSA form, i.e., some block has phis.
+  bool isSSA() const;
+
+  void invalidateCFG()
+  {
+    CFGVersion++;
+    CodeVersion++;
+  }
+
+  void invalidateCode()
+  {
+    CodeVersion++;
+  }
+
+  // Analyses of the control-flow graph, computed on demand. The results remain
+  // valid until the graph is modified, they have to be queried again after.
+  const WhileDominatorTree &dominators() const;
+  const WhileDominatorTree &postDominators() const;
+  const WhileDominanceFrontiers &frontiers() const;
+  const WhileLoopForest &loops() const;
+
+  // The def-use chains, computed on demand. They remain valid until the code is
+  // modified, except through the update functions of WhileDefUse.
+  const WhileDefUse &defUse() const;
+  WhileDefUse &defUse();
+
   std::ostream &dumpshort(std::ostream &s) const;
   std::ostream &dumphead(std::ostream &s) const;
   std::ostream &dump(std::ostream &s) const;
+
+  // Cached analyses, use the accessors above.
+  mutable WhileCachedAnalysis<WhileDominatorTree> DomTree;
+  mutable WhileCachedAnalysis<WhileDominatorTree> PostDomTree;
+  mutable WhileCachedAnalysis<WhileDominanceFrontiers> Frontiers;
+  mutable WhileCachedAnalysis<WhileLoopForest> Loops;
+  mutable std::shared_ptr<WhileDefUse> DefUseChains;
 };
 
 struct WhileProgram
 {
+  // Blocks, instructions, and operands of all functions live in the arena.
+  WhileArena Arena;
+  std::unordered_set<std::string> Strings;
+
   std::map<std::string, WhileFunction> Functions;
   std::vector<WhileFunction*> FunctionsByIndex;
   std::map<std::string, WhileSymbol*> Globals;
   unsigned int DataSize = 0;
 
+  // Whether the block counts were read from a profile.
+  bool HasProfile = false;
+
+  const char *intern(const std::string &str)
+  {
+    return Strings.insert(str).first->c_str();
+  }
+
   std::ostream &dump(std::ostream &s) const;
 };
 
-extern WhileProgram *generateCode(antlr4::tree::ParseTree *tree);
+inline WhileArena &WhileBlock::arena() const
+{
+  return Function->Program->Arena;
+}
+
+extern std::unique_ptr<WhileProgram> generateCode(antlr4::tree::ParseTree *tree);
+
+// Read the block and edge execution counts of a profile, as written by
+// WhileState::dumpProfile, into the blocks of the program. The profile has to
+// be recorded on the same, unoptimized, program. Returns false if the profile
+// does not match the program.
+extern bool readProfile(WhileProgram &p, std::istream &s);
@@ -0,0 +1,60 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file defines the call graph of a While program, along with its strongly
+// connected components, which are used to find recursive functions and to bound
+// the stack space used by the frames of a program.
+
+#include "WhileCFG.h"
+
+#include <vector>
+
+#pragma once
+
+struct WhileCallGraph
+{
+  // Functions called by each function, without builtins and duplicates, indexed
+  // by function index.
+  std::vector<std::vector<WhileFunction*> > Callees;
+
+  // Strongly connected components, callees come before their callers.
+  std::vector<std::vector<WhileFunction*> > SCCs;
+
+  // The component of each function, indexed by function index.
+  std::vector<unsigned int> SCCIndex;
+
+  // Whether the functions of each component may call themselves, indexed by
+  // component index.
+  std::vector<bool> Recursive;
+
+  explicit WhileCallGraph(const WhileProgram &p);
+
+  bool isRecursive(const WhileFunction &f) const
+  {
+    return Recursive[SCCIndex[f.Index]];
+  }
+
+  // The number of stack slots occupied by the frames of f and of the functions
+  // it calls, at any point during its execution. Recursive components hold at
+  // most recursion frames at a time, recursion is unbounded when 0, in which
+  // case -1 is returned.
+  long stackDepth(const WhileFunction &f, unsigned int recursion = 0) const;
+};
@@ -0,0 +1,184 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file defines a data-flow analysis of the registers holding a single
+// constant value at each point of a While function, used by constant
+// propagation. Functions in SSA form are handled as well.
+
+#include "WhileAnalysis.h"
+#include "WhileConstant.h"
+
+#pragma once
+
+// Registers missing from the map are TOP, i.e., not yet reached.
+typedef std::map<int, WhileConstValue> WhileConstDomain;
+
+struct WhileConstAnalysis : public WhileDataFlowAnalysis<WhileConstDomain>
+{
+  using WhileDataFlowAnalysis<WhileConstDomain>::join;
+
+  // The interpreter clears all registers on function entry, except for those
+  // receiving the arguments.
+  WhileConstDomain Entry;
+
+  void initialize(const WhileFunction &f) override
+  {
+    WhileDataFlowAnalysis<WhileConstDomain>::initialize(f);
+
+    Entry.clear();
+    for(int r : f.ParameterRegisters)
+      if (r >= 0)
+        Entry.emplace(r, WhileConstValue::bottom());
+
+    for(unsigned int r = 0; r < f.NumRegisters; r++)
+      Entry.emplace(r, WhileConstValue(0));
+  }
+
+  WhileConstDomain join(const WhileBlock *bb) override
+  {
+    std::list<WhileConstDomain> bbIn;
+    if (bb->isEntry())
+      bbIn.emplace_back(Entry);
+
+    // In SSA form, the phis of the block copy their operands at the end of the
+    // respective predecessor.
+    for(unsigned int p = 0; p < bb->Pred.size(); p++)
+    {
+      const WhileConstDomain &out = BBOut[bb->Pred[p].Block];
+      WhileConstDomain &input = bbIn.emplace_back(out);
+      for(const WhileInstr *phi : bb->Phis)
+      {
+        WhileConstValue value = readDataOperand(phi->Ops[p + 1], out);
+        if (value.Kind == WhileConstValue::TOP)
+          input.erase(phi->Ops[0].ValueOrIndex);
+        else
+          input[phi->Ops[0].ValueOrIndex] = value;
+      }
+    }
+
+    return join(bbIn);
+  }
+
+  WhileConstDomain join(std::list<WhileConstDomain> inputs) override
+  {
+    WhileConstDomain result;
+    for(const WhileConstDomain &input : inputs)
+    {
+      for(const auto &[r, value] : input)
+      {
+        auto [v, inserted] = result.emplace(r, value);
+        if (!inserted && v->second != value)
+          v->second = WhileConstValue::bottom();
+      }
+    }
+
+    return result;
+  }
+
+  static WhileConstValue readDataOperand(const WhileOperand &op,
+                                         const WhileConstDomain &input)
+  {
+    switch (op.Kind)
+    {
+      case WREGISTER:
+      {
+        auto value = input.find(op.ValueOrIndex);
+        return value == input.end() ? WhileConstValue() : value->second;
+      }
+      case WIMMEDIATE:
+        return WhileConstValue(op.ValueOrIndex);
+
+      case WFRAMEPOINTER:
+        return WhileConstValue::bottom();
+
+      case WBLOCK:
+      case WFUNCTION:
+      case WUNKNOWN:
+        assert("Operand is not a data value.");
+    }
+    abort();
+  }
+
+  static WhileConstValue evaluate(const WhileInstr &instr,
+                                  const WhileConstDomain &input)
+  {
+    if (!instr.isPure())
+      return WhileConstValue::bottom();
+
+    WhileConstValue a = readDataOperand(instr.Ops[1], input);
+    WhileConstValue b = readDataOperand(instr.Ops[2], input);
+
+    int result;
+    if (a.Kind == WhileConstValue::BOTTOM || b.Kind == WhileConstValue::BOTTOM)
+      return WhileConstValue::bottom();
+    else if (a.Kind == WhileConstValue::TOP || b.Kind == WhileConstValue::TOP)
+      return WhileConstValue();
+    else if (evaluateBinary(instr.Opc, a.Value, b.Value, result))
+      return WhileConstValue(result);
+    else
+      return WhileConstValue::bottom();
+  }
+
+  WhileConstDomain transfer(const WhileInstr &instr,
+                            const WhileConstDomain input) override
+  {
+    const WhileOperand *def = instr.def();
+    if (!def)
+      return input;
+
+    WhileConstDomain result = input;
+    WhileConstValue value = evaluate(instr, input);
+    if (value.Kind == WhileConstValue::TOP)
+      result.erase(def->ValueOrIndex);
+    else
+      result[def->ValueOrIndex] = value;
+
+    return result;
+  }
+
+  std::ostream &dump_first(std::ostream &s,
+                           const WhileConstDomain &value) override
+  {
+    s << "    [";
+    bool first = true;
+    for(const auto&[idx, c] : value)
+    {
+      if (!first)
+        s << ", ";
+
+      s << "R" << idx << "=" << c;
+      first = false;
+    }
+    return s << "]\n";
+  }
+
+  std::ostream &dump_pre(std::ostream &s,
+                         const WhileConstDomain &value) override
+  {
+    return s;
+  }
+
+  std::ostream &dump_post(std::ostream &s,
+                          const WhileConstDomain &value) override
+  {
+    return dump_first(s, value);
+  }
+};
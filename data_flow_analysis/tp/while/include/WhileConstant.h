@@ -0,0 +1,78 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file defines the lattice of constant values of registers, used by the
+// constant propagation passes and analyses.
+
+#include <cstdlib>
+#include <iostream>
+
+#pragma once
+
+struct WhileConstValue
+{
+  enum
+  {
+    TOP,
+    CONSTANT,
+    BOTTOM
+  } Kind = TOP;
+  int Value = 0;
+
+  WhileConstValue()
+  {
+  }
+
+  explicit WhileConstValue(int value) : Kind(CONSTANT), Value(value)
+  {
+  }
+
+  static WhileConstValue bottom()
+  {
+    WhileConstValue result;
+    result.Kind = BOTTOM;
+    return result;
+  }
+
+  bool operator==(const WhileConstValue &o) const
+  {
+    return Kind == o.Kind && (Kind != CONSTANT || Value == o.Value);
+  }
+
+  bool operator!=(const WhileConstValue &o) const
+  {
+    return !(*this == o);
+  }
+};
+
+inline std::ostream &operator<<(std::ostream &s, const WhileConstValue &v)
+{
+  switch (v.Kind)
+  {
+    case WhileConstValue::TOP:
+      return s << "⊤";
+    case WhileConstValue::BOTTOM:
+      return s << "⊥";
+    case WhileConstValue::CONSTANT:
+      return s << v.Value;
+  }
+  abort();
+}
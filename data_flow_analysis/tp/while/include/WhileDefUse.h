@@ -0,0 +1,116 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file defines the def-use and use-def chains of a While function. The
+// registers written and read by each instruction are recorded once, each use is
+// linked to the definitions reaching it, and each definition to the uses it
+// reaches. Phis read their operands at the end of the respective predecessor.
+// The chains are usually obtained from the cache of the function, see
+// WhileFunction::defUse, transformations can keep them up-to-date using the
+// update functions below.
+
+#include "WhileCFG.h"
+
+#include <unordered_map>
+#include <vector>
+
+#pragma once
+
+struct WhileDefUse
+{
+  struct UseInfo
+  {
+    WhileUse Use;
+    unsigned int Register;
+
+    // The definitions reaching the use, nullptr stands for the value of the
+    // register on entry of the function.
+    std::vector<WhileInstr*> Defs;
+  };
+
+  struct InstrInfo
+  {
+    // The register written by the instruction, or -1.
+    int Def = -1;
+
+    // The operands read by the instruction, the range [FirstUse, FirstUse +
+    // NumUses) of UseInfos.
+    unsigned int FirstUse = 0;
+    unsigned int NumUses = 0;
+
+    // The uses reached by the definition.
+    std::vector<WhileUse> Reached;
+  };
+
+  const WhileFunction &F;
+
+  // The value of CodeVersion of the function the chains correspond to.
+  unsigned int Version;
+
+  std::unordered_map<const WhileInstr*, InstrInfo> Instrs;
+  std::vector<UseInfo> UseInfos;
+
+  // The uses reached by the value of each register on entry, indexed by
+  // register.
+  std::vector<std::vector<WhileUse> > EntryUses;
+
+  explicit WhileDefUse(const WhileFunction &f);
+
+  const InstrInfo &info(const WhileInstr &instr) const
+  {
+    return Instrs.at(&instr);
+  }
+
+  // The uses of the instruction.
+  const UseInfo *usesBegin(const WhileInstr &instr) const
+  {
+    return UseInfos.data() + info(instr).FirstUse;
+  }
+
+  const UseInfo *usesEnd(const WhileInstr &instr) const
+  {
+    const InstrInfo &i = info(instr);
+    return UseInfos.data() + i.FirstUse + i.NumUses;
+  }
+
+  // The definitions reaching operand idx of the instruction, which has to read
+  // a register.
+  const std::vector<WhileInstr*> &defs(const WhileInstr &instr,
+                                       unsigned int idx) const;
+
+  // The uses reached by the definition of the instruction, or by the value on
+  // entry for nullptr.
+  const std::vector<WhileUse> &uses(const WhileInstr *def,
+                                    unsigned int reg) const
+  {
+    return def ? info(*def).Reached : EntryUses[reg];
+  }
+
+  // Replace operand idx of the instruction by a constant or the frame pointer,
+  // the use of the register is dropped from the chains.
+  void replaceUse(WhileInstr *instr, unsigned int idx, const WhileOperand &op);
+
+  // Remove an instruction from its block, its result must not be used.
+  void erase(WhileInstr *instr);
+
+private:
+  void unlink(UseInfo &use);
+};
@@ -0,0 +1,88 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file defines the dominator and post-dominator trees of a While function,
+// as well as its dominance frontiers. They are usually obtained from the cache
+// of the function, see WhileFunction::dominators.
+
+#include "WhileCFG.h"
+
+#include <vector>
+
+#pragma once
+
+struct WhileDominatorTree
+{
+  // Post-dominator trees are computed on the reversed control-flow graph.
+  bool Post;
+
+  // The roots of the tree, i.e., the entry block. For post-dominator trees,
+  // the blocks without successors and the blocks reaching several of them
+  // without a common post-dominator.
+  std::vector<WhileBlock*> Roots;
+
+  // Blocks reachable from the roots, in reverse post-order of the (reversed)
+  // control-flow graph.
+  std::vector<WhileBlock*> ReversePostOrder;
+
+  // Immediate dominator and dominator tree children of each block, indexed by
+  // block index. The immediate dominator of roots and of unreachable blocks is
+  // nullptr.
+  std::vector<WhileBlock*> IDom;
+  std::vector<std::vector<WhileBlock*> > Children;
+
+  // Pre- and post-order numbers of a depth-first traversal of the tree,
+  // starting at 1. Unreachable blocks are numbered 0.
+  std::vector<unsigned int> DFSIn;
+  std::vector<unsigned int> DFSOut;
+
+  explicit WhileDominatorTree(const WhileFunction &f, bool post = false);
+
+  bool isReachable(const WhileBlock *bb) const
+  {
+    return DFSIn[bb->Index] != 0;
+  }
+
+  // Check whether a dominates b, every block dominates itself.
+  bool dominates(const WhileBlock *a, const WhileBlock *b) const
+  {
+    return isReachable(a) && isReachable(b) &&
+           DFSIn[a->Index] <= DFSIn[b->Index] &&
+           DFSOut[b->Index] <= DFSOut[a->Index];
+  }
+
+  // Check whether instruction a is executed before b on every path reaching b,
+  // or after b on every path leaving b for post-dominator trees.
+  bool dominates(const WhileInstr &a, const WhileInstr &b) const
+  {
+    if (a.Block == b.Block)
+      return Post ? a.Index > b.Index : a.Index < b.Index;
+
+    return dominates(a.Block, b.Block);
+  }
+};
+
+struct WhileDominanceFrontiers
+{
+  // The dominance frontier of each block, indexed by block index.
+  std::vector<std::vector<WhileBlock*> > Frontier;
+
+  WhileDominanceFrontiers(const WhileFunction &f, const WhileDominatorTree &DT);
+};
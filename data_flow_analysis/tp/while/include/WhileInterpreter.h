@@ -27,7 +27,7 @@
 
 #pragma once
 
-typedef std::list<WhileInstr>::const_iterator instruction_pointer_t;
+typedef WhileInstrList::const_iterator instruction_pointer_t;
 
 struct WhileContext
 {
@@ -41,22 +41,48 @@ struct WhileContext
 
   WhileContext(const WhileFunction *fun, const WhileBlock *blk,
                instruction_pointer_t ip, unsigned int fp)
-    : Function(fun), Block(blk), InstructionPointer(ip), FramePointer(fp)
+    : Function(fun), Block(blk), InstructionPointer(ip), FramePointer(fp),
+      Registers(fun->NumRegisters)
   {
-    Registers.reserve(200);
   }
 };
 
 struct WhileState
 {
+  // Upper limit of the stack size, the stack grows on demand up to this size
+  // when accesses go beyond the memory allocated initially.
+  static const unsigned int MaxStackSize = 1 << 24;
+
   bool Done = false;
   unsigned int ExitState = -1;
   const WhileProgram *Program;
   std::vector<int> Memory;
   std::list<WhileContext> Context;
 
+  // Execution counts of the blocks, indexed by function and block index. Only
+  // recorded after enableProfile was called.
+  std::vector<std::vector<unsigned long> > BlockCounts;
+
+  // Number of times the branch ending each block was taken, indexed like
+  // BlockCounts.
+  std::vector<std::vector<unsigned long> > TakenCounts;
+
   explicit WhileState(const WhileProgram *program, unsigned int stacksize = 1024);
 
+  // Access the memory at the given address, growing the stack when needed.
+  // Throws std::out_of_range for addresses outside of the data and the stack.
+  int &memory(int address);
+
+  // Grow the stack to hold the frame of the context, accesses known to be
+  // within the frame are not checked.
+  void reserveFrame(const WhileContext &ctx);
+
+  void enableProfile();
+  void enterBlock(WhileContext &ctx, const WhileBlock *bb);
+
+  // Enter the target bb of the branch ending the current block.
+  void takeBranch(WhileContext &ctx, const WhileBlock *bb);
+
   int readDataOperand(const WhileInstr &i, unsigned int idx) const;
   const WhileFunction *readFunctionOperand(const WhileInstr &i) const;
   const WhileBlock *readBBOperand(const WhileInstr &i, unsigned int idx) const;
@@ -67,4 +93,8 @@ struct WhileState
            unsigned int steps = std::numeric_limits<unsigned int>::max());
 
   std::ostream &dump(std::ostream &s) const;
+
+  // Write the block counts, one line '<function> <block> <count> <taken>' per
+  // block, where taken counts the executions of the block's branch-taken edge.
+  std::ostream &dumpProfile(std::ostream &s) const;
  };
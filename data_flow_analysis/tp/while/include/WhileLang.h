@@ -19,10 +19,14 @@
 //
 
 // This file defines data structures to track variable/function symbols of While
-// programs, which are used during semantic/type checking.
+// programs, which are used during semantic/type checking and code generation.
 
+#include <cassert>
 #include <string>
 #include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #pragma once
 
@@ -36,16 +40,21 @@ enum WhileType
 
 extern const char *WhileTypes[4];
 
+// Identifiers are interned by the symbol table, two identifiers are equal if
+// and only if their pointers are equal.
+typedef const std::string *WhileIdentifier;
+
 struct WhileSymbol
 {
-  std::string Name;
+  WhileIdentifier Name;
   WhileType Type;
   unsigned int Size;
   unsigned int Offset;
+  bool Global = false;
   bool AddressTaken = false;
   std::list<int> Init;
 
-  WhileSymbol(const std::string &name, WhileType type, unsigned int size,
+  WhileSymbol(WhileIdentifier name, WhileType type, unsigned int size,
               unsigned int offset)
     : Name(name), Type(type), Size(size), Offset(offset)
   {
@@ -60,13 +69,86 @@ struct WhileScope
 
 struct WhileFunctionSymbol
 {
-  std::string Name;
+  WhileIdentifier Name;
   WhileType Type;
+  int Index;
   WhileScope Locals;
   WhileScope Parameters;
 
-  explicit WhileFunctionSymbol(const std::string &name, WhileType type)
-    : Name(name), Type(type)
+  explicit WhileFunctionSymbol(WhileIdentifier name, WhileType type, int index)
+    : Name(name), Type(type), Index(index)
+  {
+  }
+};
+
+// Map identifiers to the variables and functions visible at the current program
+// point. Variables are kept on a stack per identifier, each scope remembers the
+// identifiers it declared such that leaving the scope restores the shadowed
+// declarations. Functions live in a single global namespace.
+class WhileSymbolTable
+{
+  std::unordered_set<std::string> Identifiers;
+  std::unordered_map<WhileIdentifier, std::vector<WhileSymbol*> > Variables;
+  std::unordered_map<WhileIdentifier, WhileFunctionSymbol*> Functions;
+  std::vector<std::vector<WhileIdentifier> > Scopes;
+
+public:
+  WhileSymbolTable()
+    : Scopes(1)
+  {
+  }
+
+  WhileIdentifier intern(const std::string &name)
+  {
+    return &*Identifiers.insert(name).first;
+  }
+
+  void enterScope()
+  {
+    Scopes.emplace_back();
+  }
+
+  void exitScope()
+  {
+    assert(Scopes.size() > 1 && "Cannot leave the global scope.");
+    for(WhileIdentifier name : Scopes.back())
+    {
+      auto v = Variables.find(name);
+      v->second.pop_back();
+      if (v->second.empty())
+        Variables.erase(v);
+    }
+    Scopes.pop_back();
+  }
+
+  void declare(WhileSymbol *sym)
   {
+    Variables[sym->Name].push_back(sym);
+    Scopes.back().push_back(sym->Name);
+  }
+
+  void declare(WhileFunctionSymbol *fun)
+  {
+    Functions[fun->Name] = fun;
+  }
+
+  WhileSymbol *lookupVariable(const std::string &name) const
+  {
+    auto id = Identifiers.find(name);
+    if (id == Identifiers.end())
+      return nullptr;
+
+    auto v = Variables.find(&*id);
+    return v != Variables.end() ? v->second.back() : nullptr;
+  }
+
+  WhileFunctionSymbol *lookupFunction(const std::string &name) const
+  {
+    auto id = Identifiers.find(name);
+    if (id == Identifiers.end())
+      return nullptr;
+
+    auto f = Functions.find(&*id);
+    return f != Functions.end() ? f->second : nullptr;
   }
 };
@@ -0,0 +1,56 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file defines a backward liveness analysis of the symbolic registers of a
+// While function, which is used by transformation passes.
+
+#include "WhileCFG.h"
+
+#include <vector>
+
+#pragma once
+
+typedef std::vector<bool> WhileRegisterSet;
+
+struct WhileLiveness
+{
+  // Registers live at the beginning/end of each block, indexed by block index.
+  // In SSA form, registers defined by phis are not live at the beginning, the
+  // operands of phis are live at the end of the corresponding predecessor.
+  std::vector<WhileRegisterSet> LiveIn;
+  std::vector<WhileRegisterSet> LiveOut;
+
+  explicit WhileLiveness(const WhileFunction &f);
+
+  // Update the set of live registers backwards over an instruction.
+  static void transfer(const WhileInstr &i, WhileRegisterSet &live)
+  {
+    const WhileOperand *def = i.def();
+    if (def)
+      live[def->ValueOrIndex] = false;
+
+    for(unsigned int idx = 0; idx < i.Ops.size(); idx++)
+    {
+      const WhileOperand &op = i.Ops[idx];
+      if (op.Kind == WREGISTER && i.isUse(idx))
+        live[op.ValueOrIndex] = true;
+    }
+  }
+};
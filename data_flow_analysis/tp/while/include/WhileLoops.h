@@ -0,0 +1,91 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file defines the loop nesting forest of a While function, consisting of
+// its natural loops. It is usually obtained from the cache of the function, see
+// WhileFunction::loops.
+
+#include "WhileDominators.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#pragma once
+
+struct WhileLoop
+{
+  WhileBlock *Header;
+
+  // Sources of the back edges to the header.
+  std::vector<WhileBlock*> Latches;
+
+  // Blocks of the loop, including those of nested loops, in reverse post-order.
+  // The header comes first.
+  std::vector<WhileBlock*> Blocks;
+
+  // Edges leaving the loop, given by their source inside and their target
+  // outside of the loop.
+  std::vector<std::pair<WhileBlock*, WhileBlock*> > Exits;
+
+  WhileLoop *Parent = nullptr;
+  std::vector<WhileLoop*> Children;
+
+  // The nesting depth, outermost loops have depth 1.
+  unsigned int Depth = 1;
+
+  // Membership of blocks, indexed by block index.
+  std::vector<bool> Member;
+
+  bool contains(const WhileBlock *bb) const
+  {
+    return Member[bb->Index];
+  }
+
+  std::ostream &dump(std::ostream &s) const;
+};
+
+struct WhileLoopForest
+{
+  // All loops, outer loops come before the loops nested in them.
+  std::vector<std::unique_ptr<WhileLoop> > Loops;
+  std::vector<WhileLoop*> TopLevel;
+
+  // The innermost loop containing each block, indexed by block index.
+  std::vector<WhileLoop*> InnermostLoop;
+
+  WhileLoopForest(const WhileFunction &f, const WhileDominatorTree &DT);
+
+  unsigned int depth(const WhileBlock *bb) const
+  {
+    const WhileLoop *l = InnermostLoop[bb->Index];
+    return l ? l->Depth : 0;
+  }
+
+  std::ostream &dump(std::ostream &s) const;
+};
+
+// Give each loop of the function a preheader, i.e., the only predecessor of the
+// header from outside of the loop, having the header as its only successor.
+// Returns true if blocks were added.
+bool insertPreheaders(WhileFunction &f);
+
+// The preheader of a loop, see insertPreheaders.
+WhileBlock *preheader(const WhileLoop &loop);
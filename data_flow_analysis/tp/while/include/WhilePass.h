@@ -0,0 +1,113 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file defines a simple interface to build transformation passes for While
+// programs, along with a pass manager running pipelines of passes.
+
+#include "WhileCFG.h"
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#pragma once
+
+struct WhilePass
+{
+  const char *Name;
+  const char *Description;
+
+  // Whether the pass handles functions in SSA form, i.e., with phis. Other
+  // passes must leave such functions unchanged, and must not copy their code
+  // into other functions.
+  bool HandlesSSA;
+
+  // Transform the program, returns true when the program was modified.
+  virtual bool run(WhileProgram &p) = 0;
+
+  // Check whether the pass may transform the function.
+  bool accepts(const WhileFunction &f) const
+  {
+    return HandlesSSA || !f.isSSA();
+  }
+
+  WhilePass(const char *name, const char *descr, bool ssa = false);
+};
+
+// A pass that transforms each function of a program independently. Functions
+// in SSA form are skipped, unless the pass handles them.
+struct WhileFunctionPass : public WhilePass
+{
+  virtual bool run(WhileFunction &f) = 0;
+
+  bool run(WhileProgram &p) override
+  {
+    bool changed = false;
+    for(WhileFunction *f : p.FunctionsByIndex)
+      if (accepts(*f))
+        changed |= run(*f);
+
+    return changed;
+  }
+
+  WhileFunctionPass(const char *name, const char *descr, bool ssa = false)
+    : WhilePass(name, descr, ssa)
+  {
+  }
+};
+
+extern std::map<std::string, WhilePass*> WhilePasses;
+
+// Names of the passes run for each optimization level, in order.
+extern const std::vector<std::vector<const char *> > WhilePipelines;
+
+unsigned int countInstructions(const WhileProgram &p);
+
+// Check the consistency of the control-flow graph, i.e., block and instruction
+// numbering, terminators, successor/predecessor edges, operands, and call
+// sites. Problems are reported on s, returns true if no problem was found.
+bool verifyProgram(const WhileProgram &p, std::ostream &s);
+
+class WhilePassManager
+{
+  std::vector<WhilePass*> Pipeline;
+
+public:
+  bool Verify = true;
+  bool Stats = false;
+
+  void add(WhilePass *pass)
+  {
+    Pipeline.emplace_back(pass);
+  }
+
+  // Append the passes of the pipeline of the given optimization level.
+  void addLevel(unsigned int level);
+
+  bool empty() const
+  {
+    return Pipeline.empty();
+  }
+
+  // Run all passes in order, verifying the program after each pass. Statistics
+  // are reported on s.
+  bool run(WhileProgram &p, std::ostream &s = std::cerr);
+};
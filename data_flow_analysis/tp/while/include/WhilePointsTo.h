@@ -0,0 +1,185 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file defines an inclusion-based (Andersen-style) points-to analysis of
+// While programs. Abstract locations are the symbols of the globals and of the
+// variables living in the frames of functions. The analysis is
+// flow-insensitive and context-insensitive, it considers all functions of the
+// program at once.
+
+#include "WhileCFG.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#pragma once
+
+// A set of small integers, stored as a bitmap.
+struct WhileBitSet
+{
+  std::vector<uint64_t> Words;
+
+  bool contains(unsigned int i) const
+  {
+    return i / 64 < Words.size() && (Words[i / 64] >> (i % 64) & 1);
+  }
+
+  // Returns true if the element was not yet contained in the set.
+  bool insert(unsigned int i)
+  {
+    if (i / 64 >= Words.size())
+      Words.resize(i / 64 + 1);
+
+    uint64_t bit = (uint64_t)1 << (i % 64);
+    bool result = !(Words[i / 64] & bit);
+    Words[i / 64] |= bit;
+    return result;
+  }
+
+  // Add the elements of s, returns true if the set changed.
+  bool merge(const WhileBitSet &s)
+  {
+    if (s.Words.size() > Words.size())
+      Words.resize(s.Words.size());
+
+    bool changed = false;
+    for(unsigned int w = 0; w < s.Words.size(); w++)
+    {
+      changed |= (s.Words[w] & ~Words[w]) != 0;
+      Words[w] |= s.Words[w];
+    }
+
+    return changed;
+  }
+
+  bool intersects(const WhileBitSet &s) const
+  {
+    for(unsigned int w = 0; w < Words.size() && w < s.Words.size(); w++)
+      if (Words[w] & s.Words[w])
+        return true;
+
+    return false;
+  }
+
+  bool empty() const
+  {
+    for(uint64_t w : Words)
+      if (w)
+        return false;
+
+    return true;
+  }
+
+  // The elements of the set, in increasing order.
+  std::vector<unsigned int> elements() const
+  {
+    std::vector<unsigned int> result;
+    for(unsigned int w = 0; w < Words.size(); w++)
+      for(unsigned int b = 0; b < 64; b++)
+        if (Words[w] >> b & 1)
+          result.emplace_back(w * 64 + b);
+
+    return result;
+  }
+};
+
+struct WhilePointsTo
+{
+  // The abstract locations, the globals come first. Variables of inlined
+  // functions are a single location, shared by all copies.
+  std::vector<const WhileSymbol*> Locations;
+  std::unordered_map<const WhileSymbol*, unsigned int> LocationIndex;
+
+  // The locations whose address may be stored in memory, passed to a function,
+  // or returned, i.e., that may be accessed by called functions and by other
+  // activations of their function.
+  WhileBitSet Escaping;
+
+  explicit WhilePointsTo(const WhileProgram &p);
+
+  // The locations whose address may be held by a register of a function.
+  const WhileBitSet &pointsTo(const WhileFunction &f, unsigned int reg) const
+  {
+    return Sets[Rep[RegisterBase[f.Index] + reg]];
+  }
+
+  // The locations whose address may be stored in a location.
+  const WhileBitSet &contents(unsigned int loc) const
+  {
+    return Sets[Rep[loc]];
+  }
+
+  // The locations that may be accessed by a load or store.
+  const WhileBitSet &accessed(const WhileInstr &instr) const
+  {
+    return Sets[Rep[AccessNodes.at(&instr)]];
+  }
+
+  // Check whether two loads or stores may access the same location.
+  bool mayAlias(const WhileInstr &a, const WhileInstr &b) const
+  {
+    return accessed(a).intersects(accessed(b));
+  }
+
+  // The locations of the frame objects of a function containing a slot, or all
+  // of them for slots outside of the frame objects.
+  WhileBitSet frameLocations(const WhileFunction &f, int slot) const;
+
+private:
+  const WhileProgram &P;
+
+  // The constraint graph. The first nodes represent the contents of the
+  // locations, followed by the registers of each function, the values returned
+  // by each function, and the addresses accessed by loads and stores. Nodes
+  // found on a cycle of inclusion edges are merged, Rep holds the node
+  // representing each node.
+  std::vector<WhileBitSet> Sets;
+  std::vector<unsigned int> Rep;
+  std::vector<std::vector<unsigned int> > Succs;
+  std::vector<std::vector<unsigned int> > Loads;
+  std::vector<std::vector<unsigned int> > Stores;
+  std::unordered_set<uint64_t> Edges;
+
+  std::vector<unsigned int> RegisterBase;
+  std::vector<unsigned int> ReturnNodes;
+  unsigned int EscapeNode;
+  std::unordered_map<const WhileInstr*, unsigned int> AccessNodes;
+
+  std::vector<unsigned int> WorkList;
+  bool NewEdges = false;
+
+  unsigned int createNode();
+  unsigned int find(unsigned int n);
+  void merge(unsigned int a, unsigned int b);
+  bool addEdge(unsigned int from, unsigned int to);
+
+  // Add the global containing an address, if any.
+  void addGlobal(unsigned int n, int addr);
+
+  // Add the locations whose address may be held by an operand.
+  void addOperand(unsigned int n, const WhileInstr &instr, unsigned int idx);
+  void addInstr(const WhileFunction &f, const WhileInstr &instr);
+
+  void collapseCycles();
+  void solve();
+};
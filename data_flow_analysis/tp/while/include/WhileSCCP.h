@@ -0,0 +1,61 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file defines sparse conditional constant propagation (Wegman and
+// Zadeck) on functions in SSA form. Values are propagated along the def-use
+// chains, only considering instructions reached over executable edges.
+
+#include "WhileConstant.h"
+#include "WhileSSA.h"
+
+#include <vector>
+
+#pragma once
+
+struct WhileSCCP
+{
+  // The value of each register, indexed by register. Registers only holding
+  // their value on entry are zero, or unknown for parameters.
+  std::vector<WhileConstValue> Values;
+
+  // Whether the edges leaving each block may be executed, indexed by block
+  // index and successor kind.
+  std::vector<std::vector<bool> > Executable;
+
+  // Whether each block may be executed, indexed by block index.
+  std::vector<bool> Reachable;
+
+  // Analyze a function in SSA form, using its def-use chains.
+  WhileSCCP(const WhileFunction &f, const WhileSSA &SSA);
+
+  WhileConstValue value(const WhileOperand &op) const;
+
+private:
+  const WhileSSA &SSA;
+  std::vector<std::pair<const WhileBlock*, WhileSuccKind> > EdgeWorkList;
+  std::vector<unsigned int> RegisterWorkList;
+
+  void lower(unsigned int reg, const WhileConstValue &value);
+  void markEdge(const WhileBlock *bb, WhileSuccKind kind);
+  void visitBlock(const WhileBlock *bb);
+  void visitPhi(const WhileInstr &phi);
+  void visitInstr(const WhileInstr &instr);
+};
@@ -0,0 +1,57 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file defines the translation of While functions into and out of static
+// single assignment (SSA) form, and the def-use chains of functions in SSA
+// form. In SSA form each register is defined at most once, by an instruction or
+// a phi at the entry of a block (see WhileBlock::Phis).
+
+#include "WhileCFG.h"
+
+#include <vector>
+
+#pragma once
+
+// Translate a function into pruned SSA form. Phis are placed on the iterated
+// dominance frontiers of the definitions of registers live at these blocks,
+// then each definition is renamed to a fresh register. Registers keep their
+// value on entry of the function, i.e., parameters and zero, in their original
+// register. Unreachable blocks are removed. Returns true if the function was
+// modified.
+bool constructSSA(WhileFunction &f);
+
+// Translate a function out of SSA form. Phis are replaced by parallel copies at
+// the end of their predecessors, splitting edges from blocks with several
+// successors. Returns true if the function was modified.
+bool destructSSA(WhileFunction &f);
+
+struct WhileSSA
+{
+  // The instruction or phi defining each register, indexed by register. The
+  // entry is nullptr for registers only holding their value on entry.
+  std::vector<WhileInstr*> Defs;
+
+  // The operands reading each register, indexed by register.
+  std::vector<std::vector<WhileUse> > Uses;
+
+  // Compute the def-use chains of a function in SSA form.
+  explicit WhileSSA(const WhileFunction &f);
+};
@@ -42,6 +42,8 @@ grammar While;
   class ExprContext;
   std::list<WhileFunctionSymbol> Functions;
   WhileScope Globals;
+  WhileSymbolTable Symbols;
+  int NumFunctions = 0;
 
   bool Error = false;
 
@@ -56,22 +58,32 @@ grammar While;
     return std::cerr;
   }
 
-  template<typename T>
-  T *findSymbol(const std::string &name, std::list<T> &scope) const
+  WhileSymbol *declareVariable(WhileScope *scope, const std::string &name,
+                               WhileType type, unsigned int size)
   {
-    for(auto b = scope.rbegin(), e = scope.rend(); b != e; b++)
-    {
-      if (b->Name == name)
-        return &*b;
-    }
+    WhileSymbol &sym = scope->Symbols.emplace_back(Symbols.intern(name), type,
+                                                   size, scope->Size);
+    sym.Global = scope == &Globals;
+    scope->Size += size;
+    Symbols.declare(&sym);
+    return &sym;
+  }
 
-    return nullptr;
+  WhileFunctionSymbol *declareFunction(const std::string &name, WhileType type)
+  {
+    WhileFunctionSymbol &fun = Functions.emplace_back(Symbols.intern(name),
+                                                      type, NumFunctions++);
+    Symbols.declare(&fun);
+    Symbols.enterScope();
+    return &fun;
   }
 
-  WhileType typeOfFunction(antlr4::Token *token, std::vector<ExprContext*> args)
+  WhileType typeOfFunction(antlr4::Token *token,
+                           const std::vector<ExprContext*> &args,
+                           WhileFunctionSymbol *&fun)
   {
     std::string name = token->getText();
-    WhileFunctionSymbol *fun = findSymbol(name, Functions);
+    fun = Symbols.lookupFunction(name);
 
     if (fun)
     {
@@ -100,27 +112,16 @@ grammar While;
     }
   }
 
-  WhileType typeOfVariable(antlr4::Token *token, bool addressTaken = false)
+  WhileType typeOfVariable(antlr4::Token *token, WhileSymbol *&sym,
+                           bool addressTaken = false)
   {
     std::string name = token->getText();
-    WhileSymbol *local = findSymbol(name, Functions.back().Locals.Symbols);
-    WhileSymbol *param = findSymbol(name, Functions.back().Parameters.Symbols);
-    WhileSymbol *global = findSymbol(name, Globals.Symbols);
+    sym = Symbols.lookupVariable(name);
 
-    if (local)
-    {
-      local->AddressTaken |= addressTaken;
-      return local->Type;
-    }
-    if (param)
-    {
-      param->AddressTaken |= addressTaken;
-      return param->Type;
-    }
-    else if (global)
+    if (sym)
     {
-      global->AddressTaken |= addressTaken;
-      return global->Type;
+      sym->AddressTaken |= addressTaken;
+      return sym->Type;
     }
     else
     {
@@ -212,10 +213,10 @@ grammar While;
     return WINT;
   }
 
-  WhileType typeOfArrayAssign(antlr4::Token *id, WhileType i, WhileType r,
-                              antlr4::Token *token)
+  WhileType typeOfArrayAssign(antlr4::Token *id, WhileSymbol *&sym, WhileType i,
+                              WhileType r, antlr4::Token *token)
   {
-    WhileType l = typeOfArray(typeOfVariable(id), i, token);
+    WhileType l = typeOfArray(typeOfVariable(id, sym), i, token);
     return typeOfBinary(l, r, token);
   }
 
@@ -254,11 +255,13 @@ grammar While;
   {
     for(auto &[n,b] : WhileBuiltins)
     {
-      Functions.emplace_back(n, WINT);
-      WhileFunctionSymbol &f = Functions.back();
+      WhileFunctionSymbol &f = Functions.emplace_back(Symbols.intern(n), WINT,
+                                                      b.Index);
+      Symbols.declare(&f);
       for(WhileType t : b.ParameterTypes)
       {
-        f.Parameters.Symbols.emplace_back("a", t, 1, f.Parameters.Size++);
+        f.Parameters.Symbols.emplace_back(Symbols.intern("a"), t, 1,
+                                          f.Parameters.Size++);
       }
     }
   }
@@ -297,9 +300,9 @@ S
 
 // Parser
 param_decl
-  : 'int' ID            {Functions.back().Parameters.Symbols.emplace_back($ID.text, WINT, 1, Functions.back().Parameters.Size++);}
-  | 'int' ID '[' N ']'  {Functions.back().Parameters.Symbols.emplace_back($ID.text, WARY, $N.int, Functions.back().Parameters.Size); Functions.back().Parameters.Size+=$N.int;}
-  | 'int' '*' ID        {Functions.back().Parameters.Symbols.emplace_back($ID.text, WPTR, 1, Functions.back().Parameters.Size++);}
+  : 'int' ID            {declareVariable(&Functions.back().Parameters, $ID.text, WINT, 1);}
+  | 'int' ID '[' N ']'  {declareVariable(&Functions.back().Parameters, $ID.text, WARY, $N.int);}
+  | 'int' '*' ID        {declareVariable(&Functions.back().Parameters, $ID.text, WPTR, 1);}
   ;
 
 int_init[WhileSymbol *Sym]
@@ -315,13 +318,13 @@ array_init[WhileSymbol *Sym]
   ;
 
 var_def[WhileScope *Scope] returns[WhileSymbol *Sym]
-  : 'int' ID                {Scope->Symbols.emplace_back($ID.text, WINT, 1, Scope->Size++); $Sym=&Scope->Symbols.back();}
+  : 'int' ID                {$Sym = declareVariable(Scope, $ID.text, WINT, 1);}
     (int_init[$Sym])?
-  | 'int' ID '[' N ']'      {Scope->Symbols.emplace_back($ID.text, WARY, $N.int, Scope->Size); Scope->Size += $N.int; $Sym=&Scope->Symbols.back();}
+  | 'int' ID '[' N ']'      {$Sym = declareVariable(Scope, $ID.text, WARY, $N.int);}
     (array_init[$Sym])?     {checkArrayInit($Sym, $ID);}
-  | 'int' ID '[' ']'        {Scope->Symbols.emplace_back($ID.text, WARY, 0, Scope->Size); $Sym=&Scope->Symbols.back();}
+  | 'int' ID '[' ']'        {$Sym = declareVariable(Scope, $ID.text, WARY, 0);}
     (array_init[$Sym])?     {$Sym->Size = $Sym->Init.size(); ;Scope->Size += $Sym->Size; }
-  | 'int' '*' ID            {Scope->Symbols.emplace_back($ID.text, WPTR, 1, Scope->Size++); $Sym=&Scope->Symbols.back();}
+  | 'int' '*' ID            {$Sym = declareVariable(Scope, $ID.text, WPTR, 1);}
   ;
 
 call_args returns[std::vector<ExprContext*> args]
@@ -329,23 +332,23 @@ call_args returns[std::vector<ExprContext*> args]
   |
   ;
 
-expr returns[WhileType Ty = WERR; WhileOperand Op;]
-  : N                          {$Ty = WINT;}                                                      #ExN
-  | ID                         {$Ty = typeOfVariable($ID);}                                       #ExID
-  | ID op='[' expr ']'         {$Ty = typeOfArray(typeOfVariable($ID), $expr.Ty, $op);}           #ExArray
-  | ID ('(' call_args ')')     {$Ty = typeOfFunction($ID, $call_args.args);}                      #ExCall
-  | '&' ID                     {$Ty = WPTR; typeOfInt(typeOfVariable($ID, true), $ID);}           #ExAddr
-  | '&' ID op='[' r=expr ']'   {$Ty = WPTR; typeOfArray(typeOfVariable($ID, true), $r.Ty, $op);}  #ExArrayAddr
-  | op='*' expr                {$Ty = typeOfPtr($expr.Ty, $op);}                                  #ExPtr
-  | l=expr op='==' r=expr      {$Ty = WINT; typeOfBinary($l.Ty, $r.Ty, $op);}                     #ExEqual
-  | l=expr op='!=' r=expr      {$Ty = WINT; typeOfBinary($l.Ty, $r.Ty, $op);}                     #ExUnequal
-  | l=expr op='<' r=expr       {$Ty = WINT; typeOfBinary($l.Ty, $r.Ty, $op);}                     #ExLess
-  | l=expr op='<=' r=expr      {$Ty = WINT; typeOfBinary($l.Ty, $r.Ty, $op);}                     #ExLessEqual
-  | l=expr op='*' r=expr       {$Ty = typeOfBinary($l.Ty, $r.Ty, $op);}                           #ExMult
-  | l=expr op='/' r=expr       {$Ty = typeOfBinary($l.Ty, $r.Ty, $op);}                           #ExDiv
-  | l=expr op='+' r=expr       {$Ty = typeOfPlus($l.Ty, $r.Ty, $op);}                             #ExPlus
-  | l=expr op='-' r=expr       {$Ty = typeOfPlus($l.Ty, $r.Ty, $op);}                             #ExMinus
-  | '(' expr ')'               {$Ty = $expr.Ty;}                                                  #ExExpr
+expr returns[WhileType Ty = WERR; WhileOperand Op; WhileSymbol *Sym = nullptr; WhileFunctionSymbol *Fun = nullptr;]
+  : N                          {$Ty = WINT;}                                                            #ExN
+  | ID                         {$Ty = typeOfVariable($ID, $Sym);}                                       #ExID
+  | ID op='[' expr ']'         {$Ty = typeOfArray(typeOfVariable($ID, $Sym), $expr.Ty, $op);}           #ExArray
+  | ID ('(' call_args ')')     {$Ty = typeOfFunction($ID, $call_args.args, $Fun);}                      #ExCall
+  | '&' ID                     {$Ty = WPTR; typeOfInt(typeOfVariable($ID, $Sym, true), $ID);}           #ExAddr
+  | '&' ID op='[' r=expr ']'   {$Ty = WPTR; typeOfArray(typeOfVariable($ID, $Sym, true), $r.Ty, $op);}  #ExArrayAddr
+  | op='*' expr                {$Ty = typeOfPtr($expr.Ty, $op);}                                        #ExPtr
+  | l=expr op='==' r=expr      {$Ty = WINT; typeOfBinary($l.Ty, $r.Ty, $op);}                           #ExEqual
+  | l=expr op='!=' r=expr      {$Ty = WINT; typeOfBinary($l.Ty, $r.Ty, $op);}                           #ExUnequal
+  | l=expr op='<' r=expr       {$Ty = WINT; typeOfBinary($l.Ty, $r.Ty, $op);}                           #ExLess
+  | l=expr op='<=' r=expr      {$Ty = WINT; typeOfBinary($l.Ty, $r.Ty, $op);}                           #ExLessEqual
+  | l=expr op='*' r=expr       {$Ty = typeOfBinary($l.Ty, $r.Ty, $op);}                                 #ExMult
+  | l=expr op='/' r=expr       {$Ty = typeOfBinary($l.Ty, $r.Ty, $op);}                                 #ExDiv
+  | l=expr op='+' r=expr       {$Ty = typeOfPlus($l.Ty, $r.Ty, $op);}                                   #ExPlus
+  | l=expr op='-' r=expr       {$Ty = typeOfPlus($l.Ty, $r.Ty, $op);}                                   #ExMinus
+  | '(' expr ')'               {$Ty = $expr.Ty;}                                                        #ExExpr
   ;
 
 stmtsThen returns[WhileBlock *BBThenExit = nullptr;]
@@ -360,18 +363,18 @@ stmtsWhile
   : (statement ';')*
   ;
 
-statement returns[WhileBlock *BBStmt = nullptr;]
-  : var_def[&Functions.back().Locals]                                                           #StmtVar
-  | ID op='=' expr                        {typeOfBinary(typeOfVariable($ID), $expr.Ty, $op);}   #StmtAssign
-  | ID ('[' i=expr ']')? op='=' r=expr    {typeOfArrayAssign($ID, $i.Ty, $r.Ty, $op);}          #StmtArrayAssign
-  | '*' l=expr op='=' r=expr              {typeOfPtrAssign($l.Ty, $r.Ty, $op);}                 #StmtPtrAssign
-  | expr                                                                                        #StmtExpr
+statement returns[WhileBlock *BBStmt = nullptr; WhileSymbol *Sym = nullptr;]
+  : var_def[&Functions.back().Locals]                                                                 #StmtVar
+  | ID op='=' expr                        {typeOfBinary(typeOfVariable($ID, $Sym), $expr.Ty, $op);}   #StmtAssign
+  | ID ('[' i=expr ']')? op='=' r=expr    {typeOfArrayAssign($ID, $Sym, $i.Ty, $r.Ty, $op);}          #StmtArrayAssign
+  | '*' l=expr op='=' r=expr              {typeOfPtrAssign($l.Ty, $r.Ty, $op);}                       #StmtPtrAssign
+  | expr                                                                                              #StmtExpr
   | op='if' expr 'then'                   {typeOfInt($expr.Ty, $op);}
     stmtsThen
-    ('else' stmtsElse)? 'end'                                                                   #StmtIf
+    ('else' stmtsElse)? 'end'                                                                         #StmtIf
   | op='while' expr 'do'                  {typeOfInt($expr.Ty, $op);}
-    stmtsWhile 'end'                                                                            #StmtWhile
-  | op='return' expr                      {typeOfReturn($expr.Ty, $op);}                        #StmtReturn
+    stmtsWhile 'end'                                                                                  #StmtWhile
+  | op='return' expr                      {typeOfReturn($expr.Ty, $op);}                              #StmtReturn
   ;
 
 fun_body
@@ -384,10 +387,11 @@ parameters
 
 fun_def returns[WhileFunctionSymbol *Fun = nullptr;]locals[WhileType Ty = WINT;]
   : 'fun' ({$Ty = WPTR;}'*')? ID
-    {Functions.emplace_back($ID.text, $Ty); $Fun = &Functions.back();}
+    {$Fun = declareFunction($ID.text, $Ty);}
     parameters? 'begin'
     {$Fun->Locals.Size = $Fun->Parameters.Size;}
     fun_body 'end'
+    {Symbols.exitScope();}
   ;
 
 definition
@@ -26,6 +26,7 @@
 #include "WhileLang.h"
 #include "WhileCFG.h"
 #include "WhileColor.h"
+#include "WhileSSA.h"
 
 #include <iostream>
 #include <string>
@@ -43,8 +44,8 @@ const char *WhileTypes[4] = {"int", "int *", "int[]", "unknown"};
 
 std::map<std::string, WhileAnalysis*> WhileAnalyses;
 
-WhileAnalysis::WhileAnalysis(const char *name, const char *descr)
-  : Description(descr)
+WhileAnalysis::WhileAnalysis(const char *name, const char *descr, bool ssa)
+  : Description(descr), SSA(ssa)
 {
   WhileAnalyses.emplace(name, this);
 }
@@ -120,13 +121,29 @@ int main(int argc, char *argv[])
   if (parser.Error)
     return 2;
 
-  WhileProgram *program = generateCode(tree);
+  std::unique_ptr<WhileProgram> program = generateCode(tree);
 
   if (dump)
     program->dump(std::cout);
 
+  bool ssa = false;
   for(WhileAnalysis *a : ToRun)
-    a->analyze(*program);
+  {
+    if (a->SSA)
+      ssa = true;
+    else
+      a->analyze(*program);
+  }
+
+  if (!ssa)
+    return 0;
+
+  for(auto &[name, f] : program->Functions)
+    constructSSA(f);
+
+  for(WhileAnalysis *a : ToRun)
+    if (a->SSA)
+      a->analyze(*program);
 
   return 0;
 }
@@ -0,0 +1,230 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements the profile-guided layout of the blocks of a function.
+// Conditional branches whose taken edge is executed more often than their
+// fall-through edge are inverted, when the comparison computing the condition
+// is only used by the branch and can be negated. Blocks are then chained along
+// fall-through edges and unconditional branches, hottest edges first, and the
+// chains are placed by decreasing execution count. Edges that were never
+// executed do not join chains, moving cold blocks to the end of the function.
+// Unconditional branches to the block placed right after them are replaced by
+// fall-through edges. Without a profile, only the latter is done.
+
+#include "WhilePass.h"
+#include "WhileDefUse.h"
+
+#include <algorithm>
+
+struct WhileBlockLayout : public WhileFunctionPass
+{
+  // Find the comparison computing the condition of the branch ending bb, if it
+  // is not used otherwise.
+  static WhileInstr *invertible(WhileBlock *bb, const WhileDefUse &DU)
+  {
+    const WhileInstr *branch = bb->Body.back();
+    if (branch->Ops[0].Kind != WREGISTER)
+      return nullptr;
+
+    WhileInstr *cmp = nullptr;
+    for(unsigned int idx = branch->Index; idx-- > 0 && !cmp; )
+    {
+      const WhileOperand *def = bb->Body[idx]->def();
+      if (def && def->ValueOrIndex == branch->Ops[0].ValueOrIndex)
+        cmp = bb->Body[idx];
+    }
+
+    if (!cmp || cmp->Opc < WEQUAL || cmp->Opc > WLESSEQUAL ||
+        DU.uses(cmp, branch->Ops[0].ValueOrIndex).size() != 1)
+      return nullptr;
+
+    return cmp;
+  }
+
+  // Negate the comparison and swap the successors of the branch.
+  static void invert(WhileBlock *bb, WhileInstr *cmp)
+  {
+    switch (cmp->Opc)
+    {
+      case WEQUAL:
+        cmp->Opc = WUNEQUAL;
+        break;
+      case WUNEQUAL:
+        cmp->Opc = WEQUAL;
+        break;
+      case WLESS:
+        cmp->Opc = WLESSEQUAL;
+        std::swap(cmp->Ops[1], cmp->Ops[2]);
+        break;
+      default:
+        cmp->Opc = WLESS;
+        std::swap(cmp->Ops[1], cmp->Ops[2]);
+    }
+    bb->Function->invalidateCode();
+
+    WhileBlock *fall = bb->Succ[WFALL_THROUGH];
+    WhileBlock *taken = bb->Succ[WBRANCH_TAKEN];
+    unsigned long count = bb->edgeCount(WFALL_THROUGH);
+    bb->removeEdge(WFALL_THROUGH);
+    bb->redirectEdge(WBRANCH_TAKEN, fall);
+    bb->addEdge(WFALL_THROUGH, taken);
+    bb->TakenCount = count;
+  }
+
+  // Let the hotter edge of conditional branches fall through.
+  static bool invertBranches(WhileFunction &f)
+  {
+    const WhileDefUse &DU = f.defUse();
+    std::vector<std::pair<WhileBlock*, WhileInstr*> > branches;
+    for(WhileBlock *bb : f.Body)
+    {
+      if (bb->Body.empty() || bb->Body.back()->Opc != WBRANCHZ ||
+          bb->edgeCount(WBRANCH_TAKEN) <= bb->edgeCount(WFALL_THROUGH))
+        continue;
+
+      WhileInstr *cmp = invertible(bb, DU);
+      if (cmp)
+        branches.emplace_back(bb, cmp);
+    }
+
+    for(const auto &[bb, cmp] : branches)
+      invert(bb, cmp);
+
+    return !branches.empty();
+  }
+
+  struct Edge
+  {
+    unsigned long Count;
+    WhileBlock *From;
+    WhileBlock *To;
+  };
+
+  // Chain the blocks along the hottest edges that may fall through, starting
+  // with the entry block.
+  static std::vector<WhileBlock*> order(const WhileFunction &f)
+  {
+    std::vector<Edge> edges;
+    for(WhileBlock *bb : f.Body)
+    {
+      const WhileInstr *last = bb->Body.empty() ? nullptr : bb->Body.back();
+      if (bb->Succ[WFALL_THROUGH])
+        edges.push_back(Edge{bb->edgeCount(WFALL_THROUGH), bb,
+                             bb->Succ[WFALL_THROUGH]});
+      else if (last && last->Opc == WBRANCH)
+        edges.push_back(Edge{bb->edgeCount(WBRANCH_TAKEN), bb,
+                             bb->Succ[WBRANCH_TAKEN]});
+    }
+
+    std::stable_sort(edges.begin(), edges.end(),
+                     [](const Edge &a, const Edge &b) {
+                       return a.Count > b.Count;
+                     });
+
+    std::vector<std::vector<WhileBlock*> > chains;
+    std::vector<unsigned int> chainOf;
+    for(WhileBlock *bb : f.Body)
+    {
+      chains.push_back({bb});
+      chainOf.emplace_back(bb->Index);
+    }
+
+    bool profile = f.Program->HasProfile;
+    for(const Edge &e : edges)
+    {
+      std::vector<WhileBlock*> &from = chains[chainOf[e.From->Index]];
+      std::vector<WhileBlock*> &to = chains[chainOf[e.To->Index]];
+      if (&from == &to || from.back() != e.From || to.front() != e.To ||
+          e.To->isEntry() || (profile && !e.Count))
+        continue;
+
+      for(WhileBlock *bb : to)
+        chainOf[bb->Index] = chainOf[e.From->Index];
+      from.insert(from.end(), to.begin(), to.end());
+      to.clear();
+    }
+
+    // The chain of the entry block comes first, the others follow by
+    // decreasing count of their hottest block.
+    auto count = [](const std::vector<WhileBlock*> &chain) {
+      unsigned long result = 0;
+      for(const WhileBlock *bb : chain)
+        result = std::max(result, bb->Count);
+      return result;
+    };
+
+    std::stable_sort(chains.begin() + 1, chains.end(),
+                     [&count](const std::vector<WhileBlock*> &a,
+                              const std::vector<WhileBlock*> &b) {
+                       return count(a) > count(b);
+                     });
+
+    std::vector<WhileBlock*> result;
+    for(const std::vector<WhileBlock*> &chain : chains)
+      result.insert(result.end(), chain.begin(), chain.end());
+
+    return result;
+  }
+
+  // Replace unconditional branches to the next block by fall-through edges.
+  static bool removeBranches(WhileFunction &f)
+  {
+    bool changed = false;
+    for(unsigned int idx = 0; idx + 1 < f.Body.size(); idx++)
+    {
+      WhileBlock *bb = f.Body[idx];
+      WhileBlock *next = f.Body[idx + 1];
+      if (bb->Body.empty() || bb->Body.back()->Opc != WBRANCH ||
+          bb->Succ[WBRANCH_TAKEN] != next)
+        continue;
+
+      bb->erase(bb->Body.size() - 1);
+      bb->removeEdge(WBRANCH_TAKEN);
+      bb->addEdge(WFALL_THROUGH, next);
+      bb->TakenCount = 0;
+      changed = true;
+    }
+
+    return changed;
+  }
+
+  bool run(WhileFunction &f) override
+  {
+    bool changed = f.Program->HasProfile && invertBranches(f);
+
+    std::vector<WhileBlock*> blocks = order(f);
+    if (blocks != f.Body)
+    {
+      f.Body = blocks;
+      f.renumber();
+      changed = true;
+    }
+
+    changed |= removeBranches(f);
+    return changed;
+  }
+
+  WhileBlockLayout() : WhileFunctionPass("layout",
+                                         "Profile-guided block layout")
+  {
+  }
+};
+
+WhileBlockLayout WBL;
@@ -0,0 +1,367 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file implements the elimination of bounds checks. A forward range
+// analysis computes for each register an interval of integers, or of offsets
+// from the frame pointer, refined by the conditions of branches and widened on
+// cycles. Loads and stores whose address lies within the globals or the frame of
+// the function are marked as in bounds.
+
+#include "WhilePass.h"
+#include "WhileDominators.h"
+
+#include <algorithm>
+#include <limits>
+
+struct WhileBoundsCheckElimination : public WhileFunctionPass
+{
+  static constexpr long Min = std::numeric_limits<int>::min();
+  static constexpr long Max = std::numeric_limits<int>::max();
+
+  // Blocks are visited this many times before their ranges are widened.
+  static const unsigned int WideningDelay = 3;
+
+  enum RangeKind
+  {
+    INTEGER,
+    FRAME,
+    UNKNOWN
+  };
+
+  struct Range
+  {
+    RangeKind Kind = UNKNOWN;
+    long Lo = Min;
+    long Hi = Max;
+
+    bool operator==(const Range &o) const
+    {
+      return Kind == o.Kind && Lo == o.Lo && Hi == o.Hi;
+    }
+
+    bool operator!=(const Range &o) const
+    {
+      return !(*this == o);
+    }
+  };
+
+  typedef std::vector<Range> State;
+
+  // Values computed with the interpreter's arithmetic wrap around, ranges not
+  // fitting into an int are thus unknown.
+  static Range integer(long lo, long hi)
+  {
+    Range result;
+    result.Kind = INTEGER;
+    if (lo >= Min && hi <= Max)
+    {
+      result.Lo = lo;
+      result.Hi = hi;
+    }
+
+    return result;
+  }
+
+  static Range frame(long lo, long hi)
+  {
+    Range result;
+    if (lo >= Min && hi <= Max)
+    {
+      result.Kind = FRAME;
+      result.Lo = lo;
+      result.Hi = hi;
+    }
+
+    return result;
+  }
+
+  static Range join(const Range &a, const Range &b)
+  {
+    if (a.Kind != b.Kind)
+      return Range();
+
+    Range result = a;
+    result.Lo = std::min(a.Lo, b.Lo);
+    result.Hi = std::max(a.Hi, b.Hi);
+    return result;
+  }
+
+  static Range operand(const WhileOperand &op, const State &state)
+  {
+    switch (op.Kind)
+    {
+      case WREGISTER:
+        return state[op.ValueOrIndex];
+      case WIMMEDIATE:
+        return integer(op.ValueOrIndex, op.ValueOrIndex);
+      case WFRAMEPOINTER:
+        return frame(0, 0);
+      case WBLOCK:
+      case WFUNCTION:
+      case WUNKNOWN:
+        break;
+    }
+
+    return Range();
+  }
+
+  static Range add(const Range &a, const Range &b)
+  {
+    if (a.Kind == INTEGER && b.Kind == INTEGER)
+      return integer(a.Lo + b.Lo, a.Hi + b.Hi);
+    else if (a.Kind == FRAME && b.Kind == INTEGER)
+      return frame(a.Lo + b.Lo, a.Hi + b.Hi);
+    else if (a.Kind == INTEGER && b.Kind == FRAME)
+      return frame(a.Lo + b.Lo, a.Hi + b.Hi);
+
+    return Range();
+  }
+
+  static Range evaluate(const WhileInstr &instr, const State &state)
+  {
+    if (!instr.isPure())
+      return integer(Min, Max);
+
+    Range a = operand(instr.Ops[1], state);
+    Range b = operand(instr.Ops[2], state);
+    switch (instr.Opc)
+    {
+      case WPLUS:
+        return add(a, b);
+      case WMINUS:
+        if (a.Kind == FRAME && b.Kind == INTEGER)
+          return frame(a.Lo - b.Hi, a.Hi - b.Lo);
+        else if (a.Kind == b.Kind && a.Kind != UNKNOWN)
+          return integer(a.Lo - b.Hi, a.Hi - b.Lo);
+        break;
+      case WMULT:
+      case WDIV:
+      {
+        if (a.Kind != INTEGER || b.Kind != INTEGER)
+          break;
+        else if (instr.Opc == WDIV && b.Lo <= 0 && b.Hi >= 0)
+          return integer(Min, Max);
+
+        // Both operations are monotonic in each operand, for divisors of
+        // constant sign.
+        long lo = Max + 1, hi = Min - 1;
+        for(long x : {a.Lo, a.Hi})
+        {
+          for(long y : {b.Lo, b.Hi})
+          {
+            long v = instr.Opc == WMULT ? x * y : x / y;
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+          }
+        }
+        return integer(lo, hi);
+      }
+      default:
+        return integer(0, 1);
+    }
+
+    return Range();
+  }
+
+  static void transfer(const WhileInstr &instr, State &state)
+  {
+    const WhileOperand *def = instr.def();
+    if (def)
+      state[def->ValueOrIndex] = evaluate(instr, state);
+  }
+
+  // Restrict the ranges of the operands of a comparison a < b, or a <= b, to
+  // the values satisfying it. Returns false if no values remain.
+  static bool constrain(Range &a, Range &b, bool strict)
+  {
+    if (a.Kind != b.Kind || a.Kind == UNKNOWN)
+      return true;
+
+    a.Hi = std::min(a.Hi, b.Hi - strict);
+    b.Lo = std::max(b.Lo, a.Lo + strict);
+    return a.Lo <= a.Hi && b.Lo <= b.Hi;
+  }
+
+  // Refine the state at the end of a block for the edge of the given kind,
+  // using the comparison computing the condition of a final branch. Returns
+  // false if the edge cannot be taken.
+  static bool refine(const WhileBlock &bb, WhileSuccKind kind, State &state)
+  {
+    const WhileInstr *branch = bb.Body.empty() ? nullptr : bb.Body.back();
+    if (!branch || branch->Opc != WBRANCHZ ||
+        branch->Ops[0].Kind != WREGISTER)
+      return true;
+
+    // Find the comparison, its operands must not be modified before the branch.
+    const WhileInstr *cmp = nullptr;
+    for(unsigned int idx = branch->Index; idx-- > 0 && !cmp; )
+    {
+      const WhileOperand *def = bb.Body[idx]->def();
+      if (def && def->ValueOrIndex == branch->Ops[0].ValueOrIndex)
+        cmp = bb.Body[idx];
+    }
+
+    if (!cmp || cmp->Opc < WEQUAL || cmp->Opc > WLESSEQUAL)
+      return true;
+
+    for(unsigned int idx = cmp->Index; idx < branch->Index; idx++)
+    {
+      const WhileOperand *def = bb.Body[idx]->def();
+      for(unsigned int op = 1; op < 3; op++)
+        if (def && cmp->Ops[op].Kind == WREGISTER &&
+            cmp->Ops[op].ValueOrIndex == def->ValueOrIndex)
+          return true;
+    }
+
+    // The fall-through edge is taken when the condition holds.
+    Range a = operand(cmp->Ops[1], state);
+    Range b = operand(cmp->Ops[2], state);
+    bool holds = kind == WFALL_THROUGH;
+    bool feasible = true;
+    switch (cmp->Opc)
+    {
+      case WLESS:
+        feasible = holds ? constrain(a, b, true) : constrain(b, a, false);
+        break;
+      case WLESSEQUAL:
+        feasible = holds ? constrain(a, b, false) : constrain(b, a, true);
+        break;
+      case WEQUAL:
+      case WUNEQUAL:
+        if (holds == (cmp->Opc == WEQUAL))
+          feasible = constrain(a, b, false) && constrain(b, a, false);
+        break;
+      default:
+        abort();
+    }
+
+    if (cmp->Ops[1].Kind == WREGISTER)
+      state[cmp->Ops[1].ValueOrIndex] = a;
+    if (cmp->Ops[2].Kind == WREGISTER)
+      state[cmp->Ops[2].ValueOrIndex] = b;
+
+    return feasible;
+  }
+
+  bool isInBounds(const WhileFunction &f, const WhileInstr &instr,
+                  const State &state) const
+  {
+    unsigned int base = instr.Opc == WLOAD ? 1 : 0;
+    Range addr = add(operand(instr.Ops[base], state),
+                     operand(instr.Ops[base + 1], state));
+    if (addr.Kind == INTEGER)
+      return addr.Lo >= 0 && addr.Hi < (long)f.Program->DataSize;
+    else if (addr.Kind == FRAME)
+      return addr.Lo >= 0 && addr.Hi < (long)f.FrameSize;
+
+    return false;
+  }
+
+  bool run(WhileFunction &f) override
+  {
+    // Registers are zero on entry, except for parameters.
+    std::vector<State> in(f.Body.size(), State(f.NumRegisters));
+    std::vector<bool> reached(f.Body.size());
+    std::vector<unsigned int> visits(f.Body.size());
+    in[0].assign(f.NumRegisters, integer(0, 0));
+    for(int reg : f.ParameterRegisters)
+      if (reg >= 0)
+        in[0][reg] = integer(Min, Max);
+    reached[0] = true;
+
+    const WhileDominatorTree &DT = f.dominators();
+    bool changed = true;
+    while (changed)
+    {
+      changed = false;
+      for(const WhileBlock *bb : DT.ReversePostOrder)
+      {
+        if (!reached[bb->Index])
+          continue;
+
+        State state = in[bb->Index];
+        for(const WhileInstr *instr : bb->Body)
+          transfer(*instr, state);
+
+        for(WhileSuccKind kind : {WFALL_THROUGH, WBRANCH_TAKEN})
+        {
+          const WhileBlock *succ = bb->Succ[kind];
+          State out = state;
+          if (!succ || !refine(*bb, kind, out))
+            continue;
+
+          unsigned int s = succ->Index;
+          if (!reached[s])
+          {
+            reached[s] = true;
+            in[s] = out;
+            changed = true;
+            continue;
+          }
+
+          bool widen = ++visits[s] > WideningDelay;
+          for(unsigned int r = 0; r < f.NumRegisters; r++)
+          {
+            Range old = in[s][r];
+            Range merged = join(old, out[r]);
+            if (widen && merged.Kind == old.Kind)
+            {
+              merged.Lo = merged.Lo < old.Lo ? Min : merged.Lo;
+              merged.Hi = merged.Hi > old.Hi ? Max : merged.Hi;
+            }
+
+            if (merged != old)
+            {
+              in[s][r] = merged;
+              changed = true;
+            }
+          }
+        }
+      }
+    }
+
+    bool modified = false;
+    for(WhileBlock *bb : f.Body)
+    {
+      State state = in[bb->Index];
+      for(WhileInstr *instr : bb->Body)
+      {
+        if (instr->Opc == WLOAD || instr->Opc == WSTORE)
+        {
+          bool inbounds = reached[bb->Index] && isInBounds(f, *instr, state);
+          modified |= inbounds != instr->InBounds;
+          instr->InBounds = inbounds;
+        }
+
+        transfer(*instr, state);
+      }
+    }
+
+    return modified;
+  }
+
+  WhileBoundsCheckElimination() : WhileFunctionPass("boundscheck",
+                                                    "Bounds-check elimination")
+  {
+  }
+};
+
+WhileBoundsCheckElimination WBCE;
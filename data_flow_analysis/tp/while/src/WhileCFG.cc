@@ -26,7 +26,9 @@
 
 #include "WhileBaseListener.h"
 
+#include <algorithm>
 #include <cassert>
+#include <limits>
 
 // implemented in WhileInterpreter.cc
 extern int WhilePrintInt(WhileState &s, std::vector<int> &ops);
@@ -45,13 +47,45 @@ std::map<std::string, WhileBuiltin> WhileBuiltins =
 
 const char *WhileOpcodes[] = {"WCALL", "WLOAD", "WSTORE", "WPLUS", "WMINUS",
                               "WMULT", "WDIR", "WEQUAL", "WUNEQUAL", "WLESS",
-                              "WLESSEQUAL", "WBRANCHZ", "WBRANCH", "WRETURN"};
+                              "WLESSEQUAL", "WBRANCHZ", "WBRANCH", "WRETURN",
+                              "WPHI"};
 
 const char *WhileSuccKinds[] = {"FT", "BT"};
 
+bool evaluateBinary(WhileOpcode opc, int a, int b, int &result)
+{
+  // wrap around on overflow, as the interpreter does in practice
+  unsigned int ua = a, ub = b;
+  switch (opc)
+  {
+    case WPLUS:       result = ua + ub;  return true;
+    case WMINUS:      result = ua - ub;  return true;
+    case WMULT:       result = ua * ub;  return true;
+    case WEQUAL:      result = a == b;   return true;
+    case WUNEQUAL:    result = a != b;   return true;
+    case WLESS:       result = a < b;    return true;
+    case WLESSEQUAL:  result = a <= b;   return true;
+    case WDIV:
+      if (b == 0 || (a == std::numeric_limits<int>::min() && b == -1))
+        return false;
+      result = a / b;
+      return true;
+
+    case WCALL:
+    case WLOAD:
+    case WSTORE:
+    case WBRANCHZ:
+    case WBRANCH:
+    case WRETURN:
+    case WPHI:
+      return false;
+  }
+  abort();
+}
+
 class  WhileCodeGenListener : public WhileBaseListener {
 public:
-  WhileProgram *Program;
+  std::unique_ptr<WhileProgram> Program;
   WhileFunction *CurrentFunction = nullptr;
   WhileBlock *CurrentBlock = nullptr;
 
@@ -69,12 +103,11 @@ public:
     return !sym->AddressTaken && sym->Size == 1;
   }
 
-  std::pair<bool, WhileOperand> registerOfVar(std::string name)
+  std::pair<bool, WhileOperand> registerOfVar(WhileSymbol *sym)
   {
-    auto local = CurrentFunction->Locals.find(name);
-    if (local != CurrentFunction->Locals.end() && useRegister(local->second))
+    if (!sym->Global && useRegister(sym))
     {
-      auto reg = CurrentFunction->Registers.find(local->second);
+      auto reg = CurrentFunction->Registers.find(sym);
       if(reg != CurrentFunction->Registers.end())
       {
         return std::pair(true, reg->second);
@@ -84,18 +117,9 @@ public:
     return std::pair(false, WhileOperand());;
   }
 
-  WhileOperand getFunOp(const std::string &name)
+  WhileOperand getFunOp(const WhileFunctionSymbol *fun)
   {
-    auto f = Program->Functions.find(name);
-    if (f != Program->Functions.end())
-      return WhileOperand(WFUNCTION, f->second.Index, name);
-    else
-    {
-      auto b = WhileBuiltins.find(name);
-      assert(b != WhileBuiltins.end());
-      return WhileOperand(WFUNCTION, b->second.Index, b->first);
-    }
-    abort();
+    return WhileOperand(WFUNCTION, fun->Index, Program->intern(*fun->Name));
   }
 
   WhileOperand getBBOp(const WhileBlock *bb)
@@ -113,51 +137,54 @@ public:
     return WhileOperand(WREGISTER, FreeRegister++);
   }
 
+  static bool endsWithJump(const WhileBlock *bb)
+  {
+    WhileOpcode lastopc = bb->Body.empty() ? WPLUS : bb->Body.back()->Opc;
+    return lastopc == WRETURN || lastopc == WBRANCH;
+  }
+
   WhileBlock *newBlock(bool fallthrough)
   {
     WhileBlock *pred = CurrentBlock;
 
-    CurrentFunction->Body.emplace_back(CurrentFunction->Body.size(),
-                                       CurrentFunction);
-    CurrentBlock = &CurrentFunction->Body.back();
+    CurrentBlock = CurrentFunction->createBlock();
 
-    if (fallthrough)
-    {
-      pred->Succ.emplace(WFALL_THROUGH, CurrentBlock);
-      CurrentBlock->Pred.emplace(pred, WFALL_THROUGH);
-    }
+    if (fallthrough && !endsWithJump(pred))
+      pred->addEdge(WFALL_THROUGH, CurrentBlock);
 
     return pred;
   }
 
   void newEdge(WhileBlock *pred, WhileBlock *succ)
   {
-    bool inserted = pred->Succ.emplace(WBRANCH_TAKEN, succ).second;
-    succ->Pred.emplace(pred, WBRANCH_TAKEN);
-
-    assert(inserted && "Multiple taken branches");
+    assert(!pred->Succ[WBRANCH_TAKEN] && "Multiple taken branches");
+    pred->addEdge(WBRANCH_TAKEN, succ);
   }
 
 
   WhileInstr &emitInstr(antlr4::Token *t, WhileOpcode opc,
-                        WhileBlock *block = nullptr)
+                        unsigned int numops, WhileBlock *block = nullptr)
   {
     if (block == nullptr)
+    {
+      // code following a return is unreachable
+      if (endsWithJump(CurrentBlock))
+        newBlock(false);
       block = CurrentBlock;
+    }
 
-    block->Body.emplace_back(block->Body.size(),
-                             t->getLine(), t->getCharPositionInLine(),
-                             opc, block);
-    return block->Body.back();
+    return block->append(block->createInstr(t->getLine(),
+                                            t->getCharPositionInLine(),
+                                            opc, numops));
   }
 
   WhileInstr &emitStore(antlr4::Token *t, WhileOperand address,
                         WhileOperand offset, WhileOperand valuetostore)
   {
-    WhileInstr &store = emitInstr(t, WSTORE);
-    store.Ops.emplace_back(address);
-    store.Ops.emplace_back(offset);
-    store.Ops.emplace_back(valuetostore);
+    WhileInstr &store = emitInstr(t, WSTORE, 3);
+    store.Ops[0] = address;
+    store.Ops[1] = offset;
+    store.Ops[2] = valuetostore;
 
     return store;
   }
@@ -165,10 +192,10 @@ public:
   WhileInstr &emitLoad(antlr4::Token *t, WhileOperand dest,
                        WhileOperand address, WhileOperand offset)
   {
-    WhileInstr &load = emitInstr(t, WLOAD);
-    load.Ops.emplace_back(dest);
-    load.Ops.emplace_back(address);
-    load.Ops.emplace_back(offset);
+    WhileInstr &load = emitInstr(t, WLOAD, 3);
+    load.Ops[0] = dest;
+    load.Ops[1] = address;
+    load.Ops[2] = offset;
 
     return load;
   }
@@ -176,10 +203,10 @@ public:
   WhileInstr &emitBinary(antlr4::Token *t, WhileOpcode opc, WhileOperand dest,
                          WhileOperand a, WhileOperand b)
   {
-    WhileInstr &binary = emitInstr(t, opc);
-    binary.Ops.emplace_back(dest);
-    binary.Ops.emplace_back(a);
-    binary.Ops.emplace_back(b);
+    WhileInstr &binary = emitInstr(t, opc, 3);
+    binary.Ops[0] = dest;
+    binary.Ops[1] = a;
+    binary.Ops[2] = b;
 
     return binary;
   }
@@ -192,7 +219,7 @@ public:
 
   void emitBranch(antlr4::Token *t, WhileBlock *block, WhileBlock *dest)
   {
-    WhileOpcode lastopc = block->Body.empty() ? WPLUS : block->Body.back().Opc;
+    WhileOpcode lastopc = block->Body.empty() ? WPLUS : block->Body.back()->Opc;
     switch (lastopc)
     {
       case WRETURN:
@@ -215,47 +242,47 @@ public:
       case WLESS:
       case WLESSEQUAL:
       {
-        WhileInstr &branch = emitInstr(t, WBRANCH, block);
-        branch.Ops.emplace_back(getBBOp(dest));
+        WhileInstr &branch = emitInstr(t, WBRANCH, 1, block);
+        branch.Ops[0] = getBBOp(dest);
         newEdge(block, dest);
         return;
       }
+
+      case WPHI:
+        // phis are not emitted by the code generator
+        break;
     };
     abort();
   }
 
 
-  std::pair<WhileOperand, WhileOperand> getVarAddress(std::string name)
+  std::pair<WhileOperand, WhileOperand> getVarAddress(WhileSymbol *sym)
   {
-    auto local = CurrentFunction->Locals.find(name);
-    auto global = Program->Globals.find(name);
-
     WhileOperand base = getValOp(0);
     WhileOperand offset = getValOp(0);
-    if (local != CurrentFunction->Locals.end())
+    if (!sym->Global)
     {
-      assert(CurrentFunction->Registers.find(local->second) == CurrentFunction->Registers.end());
+      assert(CurrentFunction->Registers.find(sym) == CurrentFunction->Registers.end());
       base = FramePointer;
-      offset = getValOp(local->second->Offset);
-      if (local->second->Offset)
-        offset.Symbol = local->second;
+      offset = getValOp(sym->Offset);
+      if (sym->Offset)
+        offset.Symbol = sym;
       else
-        base.Symbol = local->second;
+        base.Symbol = sym;
     }
     else
     {
-      assert(global != Program->Globals.end());
-      offset = getValOp(global->second->Offset);
-      offset.Symbol = global->second;
+      offset = getValOp(sym->Offset);
+      offset.Symbol = sym;
     }
 
     return std::pair(base, offset);
   }
 
-  std::pair<WhileOperand, WhileOperand> computeArrayAddr(std::string name,
+  std::pair<WhileOperand, WhileOperand> computeArrayAddr(WhileSymbol *sym,
       WhileOperand arrayIndex, antlr4::Token *token)
   {
-    auto [base, offset] = getVarAddress(name);
+    auto [base, offset] = getVarAddress(sym);
     WhileOperand arrayBase;
 
     if (arrayBase.isZero())
@@ -274,8 +301,9 @@ public:
   virtual void enterFun_def(WhileParser::Fun_defContext *ctx) override
   {
     FreeRegister = 0;
-    auto [f, b] = Program->Functions.try_emplace(ctx->ID()->getText(),
-        ctx->ID()->getText(), Program->Functions.size(), Program);
+    assert(ctx->Fun->Index == (int)Program->FunctionsByIndex.size());
+    auto [f, b] = Program->Functions.try_emplace(*ctx->Fun->Name,
+        *ctx->Fun->Name, ctx->Fun->Index, Program.get());
     CurrentFunction = &f->second;
     Program->FunctionsByIndex.emplace_back(CurrentFunction);
 
@@ -283,15 +311,21 @@ public:
 
     for(WhileSymbol &p : ctx->Fun->Parameters.Symbols)
     {
-      CurrentFunction->Locals.emplace(p.Name, &p);
+      CurrentFunction->Locals.emplace(*p.Name, &p);
       CurrentFunction->FrameSize += p.Size;
 
+      // Scalar parameters are passed directly in registers by the caller.
       if (useRegister(&p))
       {
         WhileOperand reg(getRegOp());
         reg.Symbol = &p;
         CurrentFunction->Registers.emplace(&p, reg);
-        emitLoad(ctx->getStart(), reg, FramePointer, getValOp(p.Offset));
+        CurrentFunction->ParameterRegisters.emplace_back(reg.ValueOrIndex);
+      }
+      else
+      {
+        CurrentFunction->ParameterRegisters.emplace_back(-1);
+        CurrentFunction->FrameObjects.push_back({p.Offset, p.Size, &p});
       }
     }
   }
@@ -300,7 +334,7 @@ public:
   {
     WhileSymbol *sym = ctx->var_def()->Sym;
 
-    Program->Globals.emplace(sym->Name, sym);
+    Program->Globals.emplace(*sym->Name, sym);
     Program->DataSize += sym->Size;
   }
 
@@ -309,7 +343,7 @@ public:
     WhileSymbol *sym = ctx->var_def()->Sym;
     antlr4::Token *token = ctx->getStart();
 
-    CurrentFunction->Locals.emplace(sym->Name, sym);
+    CurrentFunction->Locals.emplace(*sym->Name, sym);
     CurrentFunction->FrameSize += sym->Size;
 
     bool usereg = useRegister(sym);
@@ -320,6 +354,8 @@ public:
       reg.Symbol = sym;
       CurrentFunction->Registers.emplace(sym, reg);
     }
+    else
+      CurrentFunction->FrameObjects.push_back({sym->Offset, sym->Size, sym});
 
     unsigned int idx = 0;
     for(int value : sym->Init)
@@ -340,22 +376,21 @@ public:
 
   virtual void exitStmtAssign(WhileParser::StmtAssignContext *ctx) override
   {
-    std::string name = ctx->ID()->getText();
     const WhileOperand &valuetostore = ctx->expr()->Op;
     antlr4::Token *token = ctx->getStart();
-    auto [usereg, regop] = registerOfVar(name);
+    auto [usereg, regop] = registerOfVar(ctx->Sym);
     if (usereg)
       emitPlus(token, regop, getValOp(0), valuetostore);
     else
     {
-      auto [base, offset] = getVarAddress(name);
+      auto [base, offset] = getVarAddress(ctx->Sym);
       emitStore(token, base, offset, valuetostore);
     }
   }
 
   virtual void exitStmtArrayAssign(WhileParser::StmtArrayAssignContext *ctx) override
   {
-    auto [base, index] = computeArrayAddr(ctx->ID()->getText(), ctx->i->Op,
+    auto [base, index] = computeArrayAddr(ctx->Sym, ctx->i->Op,
                                           ctx->getStart());
     emitStore(ctx->getStart(), base, index, ctx->r->Op);
   }
@@ -397,9 +432,9 @@ public:
     WhileBlock *bbThenExit = ctx->stmtsThen()->BBThenExit;
     WhileBlock *bbElseEntry = ctx->stmtsElse() ? ctx->stmtsElse()->BBElseEntry : bbEnd;
 
-    WhileInstr &condBranch = emitInstr(t, WBRANCHZ, bbStmt);
-    condBranch.Ops.emplace_back(ctx->expr()->Op);
-    condBranch.Ops.emplace_back(getBBOp(bbElseEntry));
+    WhileInstr &condBranch = emitInstr(t, WBRANCHZ, 2, bbStmt);
+    condBranch.Ops[0] = ctx->expr()->Op;
+    condBranch.Ops[1] = getBBOp(bbElseEntry);
     newEdge(bbStmt, bbElseEntry);
     // fall-through added by enterStmtsThen
 
@@ -427,9 +462,9 @@ public:
     emitBranch(t, CurrentBlock, bbStmt);
     newBlock(false);
 
-    WhileInstr &condBranch = emitInstr(t, WBRANCHZ, bbStmt);
-    condBranch.Ops.emplace_back(ctx->expr()->Op);
-    condBranch.Ops.emplace_back(getBBOp(CurrentBlock));
+    WhileInstr &condBranch = emitInstr(t, WBRANCHZ, 2, bbStmt);
+    condBranch.Ops[0] = ctx->expr()->Op;
+    condBranch.Ops[1] = getBBOp(CurrentBlock);
     newEdge(bbStmt, CurrentBlock);
     // fall-through of bbStmt added in enterStmtsWhile
   }
@@ -437,8 +472,8 @@ public:
   virtual void exitStmtReturn(WhileParser::StmtReturnContext *ctx) override
   {
     antlr4::Token *t = ctx->getStart();
-    WhileInstr &ret = emitInstr(t, WRETURN);
-    ret.Ops.emplace_back(ctx->expr()->Op);
+    WhileInstr &ret = emitInstr(t, WRETURN, 1);
+    ret.Ops[0] = ctx->expr()->Op;
   }
 
   virtual void exitExN(WhileParser::ExNContext *ctx) override
@@ -448,13 +483,12 @@ public:
 
   virtual void exitExID(WhileParser::ExIDContext *ctx) override
   {
-    std::string name = ctx->ID()->getText();
-    auto [usereg, regop] = registerOfVar(name);
+    auto [usereg, regop] = registerOfVar(ctx->Sym);
     if (usereg)
       ctx->Op = regop;
     else
     {
-      auto [base, offset] = getVarAddress(name);
+      auto [base, offset] = getVarAddress(ctx->Sym);
       emitLoad(ctx->getStart(), ctx->Op = getRegOp(), base, offset);
     }
   }
@@ -462,13 +496,15 @@ public:
   virtual void exitExCall(WhileParser::ExCallContext *ctx) override
   {
     antlr4::Token *t = ctx->getStart();
-    WhileInstr &call = emitInstr(t, WCALL);
-    WhileOperand funop(getFunOp(ctx->ID()->getText()));
-    call.Ops.emplace_back(funop);
-    call.Ops.emplace_back(ctx->Op = getRegOp());
+    const auto &args = ctx->call_args()->expr();
+    WhileInstr &call = emitInstr(t, WCALL, args.size() + 2);
+    WhileOperand funop(getFunOp(ctx->Fun));
+    call.Ops[0] = funop;
+    call.Ops[1] = ctx->Op = getRegOp();
 
-    for(const WhileParser::ExprContext*ex : ctx->call_args()->expr())
-      call.Ops.emplace_back(ex->Op);
+    unsigned int idx = 2;
+    for(const WhileParser::ExprContext*ex : args)
+      call.Ops[idx++] = ex->Op;
 
     if (0 <= funop.ValueOrIndex)
     {
@@ -486,7 +522,7 @@ public:
 
   virtual void exitExAddr(WhileParser::ExAddrContext *ctx) override
   {
-    auto [base, offset] = getVarAddress(ctx->ID()->getText());
+    auto [base, offset] = getVarAddress(ctx->Sym);
     if (base.isZero())
       ctx->Op = offset;
     else
@@ -500,7 +536,7 @@ public:
 
   virtual void exitExArrayAddr(WhileParser::ExArrayAddrContext *ctx) override
   {
-    auto [base, index] = computeArrayAddr(ctx->ID()->getText(), ctx->expr()->Op,
+    auto [base, index] = computeArrayAddr(ctx->Sym, ctx->expr()->Op,
                                           ctx->getStart());
 
     if (index.isZero())
@@ -569,7 +605,7 @@ public:
 
   virtual void exitExArray(WhileParser::ExArrayContext *ctx) override
   {
-    auto [base, index] = computeArrayAddr(ctx->ID()->getText(), ctx->expr()->Op,
+    auto [base, index] = computeArrayAddr(ctx->Sym, ctx->expr()->Op,
                                           ctx->getStart());
     emitLoad(ctx->getStart(), ctx->Op = getRegOp(), base, index);
   }
@@ -582,7 +618,7 @@ public:
   virtual void exitFun_def(WhileParser::Fun_defContext *ctx) override
   {
     WhileOpcode lastopc = CurrentBlock->Body.empty() ? WPLUS :
-                                                  CurrentBlock->Body.back().Opc;
+                                                 CurrentBlock->Body.back()->Opc;
     switch (lastopc)
     {
       case WRETURN:
@@ -605,10 +641,17 @@ public:
       case WLESSEQUAL:
       {
         antlr4::Token *t = ctx->getStop();
-        WhileInstr &ret = emitInstr(t, WRETURN);
-        ret.Ops.emplace_back(getValOp(0));
+        WhileInstr &ret = emitInstr(t, WRETURN, 1);
+        ret.Ops[0] = getValOp(0);
+        break;
       }
+
+      case WPHI:
+        // phis are not emitted by the code generator
+        abort();
     }
+
+    CurrentFunction->NumRegisters = FreeRegister;
   }
 };
 
@@ -630,6 +673,34 @@ std::ostream &WhileOperand::dump(std::ostream &s) const
   abort();
 }
 
+bool WhileInstr::inTailPosition() const
+{
+  if (Opc != WCALL || Ops[1].Kind != WREGISTER)
+    return false;
+
+  const WhileInstr *ret = nullptr;
+  if (Index + 1 < Block->Body.size())
+    ret = Block->Body[Index + 1];
+  else if (!Block->Succ[WBRANCH_TAKEN])
+  {
+    // Bound the walk by the number of blocks, in case of a cycle of empty
+    // blocks.
+    const WhileBlock *bb = Block->Succ[WFALL_THROUGH];
+    unsigned int numblocks = Block->Function->Body.size();
+    for(unsigned int n = 0; bb && bb->Body.empty() && n < numblocks; n++)
+      bb = bb->Succ[WFALL_THROUGH];
+
+    if (bb && !bb->Body.empty())
+      ret = bb->Body.front();
+  }
+
+  if (!ret)
+    return false;
+
+  return ret->Opc == WRETURN && ret->Ops[0].Kind == WREGISTER &&
+         ret->Ops[0].ValueOrIndex == Ops[1].ValueOrIndex;
+}
+
 std::ostream &WhileInstr::dump(std::ostream &s) const
 {
   s << std::setw(10) << WhileOpcodes[Opc] << "  ";
@@ -651,10 +722,10 @@ std::ostream &WhileInstr::dump(std::ostream &s) const
     {
       if (first)
         s << ":";
-      s << " " << op.Symbol->Name;
+      s << " " << *op.Symbol->Name;
       first = false;
     }
-    if (!op.Comment.empty())
+    if (op.Comment)
     {
       if (first)
         s << ":";
@@ -663,6 +734,12 @@ std::ostream &WhileInstr::dump(std::ostream &s) const
     }
   }
 
+  if (InBounds)
+    s << " (in bounds)";
+
+  if (TailCall)
+    s << " (tail call)";
+
   return s;
 }
 
@@ -684,11 +761,13 @@ std::ostream &WhileBlock::dumphead(std::ostream &s) const
   }
   s << "] -> [";
   first = true;
-  for(auto &[kind, succ] : Succ)
+  for(unsigned int kind = WFALL_THROUGH; kind <= WBRANCH_TAKEN; kind++)
   {
+    if (!Succ[kind])
+      continue;
     if (!first)
       s << ", ";
-    s << "BB" << succ->Index << " (" << WhileSuccKinds[kind] << ")";
+    s << "BB" << Succ[kind]->Index << " (" << WhileSuccKinds[kind] << ")";
     first = false;
   }
   return s << "]";
@@ -698,10 +777,16 @@ std::ostream &WhileBlock::dump(std::ostream &s) const
 {
   dumphead(s) << "\n";
 
-  for (const WhileInstr &i : Body)
+  for (const WhileInstr *i : Phis)
   {
-    s << std::setw(4) << i.Index << ": ";
-    i.dump(s) << "\n";
+    s << std::setw(4) << "phi" << ": ";
+    i->dump(s) << "\n";
+  }
+
+  for (const WhileInstr *i : Body)
+  {
+    s << std::setw(4) << i->Index << ": ";
+    i->dump(s) << "\n";
   }
 
   return s;
@@ -754,8 +839,8 @@ std::ostream &WhileFunction::dumphead(std::ostream &s) const
 std::ostream &WhileFunction::dump(std::ostream &s) const
 {
   dumphead(s);
-  for (const WhileBlock &b : Body)
-    b.dump(s);
+  for (const WhileBlock *b : Body)
+    b->dump(s);
 
   return s;
 }
@@ -784,10 +869,280 @@ std::ostream &WhileProgram::dump(std::ostream &s) const
 }
 
 
-WhileProgram *generateCode(antlr4::tree::ParseTree *tree)
+WhileInstr *WhileBlock::createInstr(unsigned int line, unsigned int offs,
+                                    WhileOpcode opc, unsigned int numops)
+{
+  WhileArena &a = arena();
+  WhileInstr *i = a.create<WhileInstr>(Body.size(), line, offs, opc, this);
+  i->Ops.Data = a.allocateArray<WhileOperand>(numops);
+  i->Ops.Size = numops;
+  return i;
+}
+
+WhileInstr *WhileBlock::createMove(const WhileInstr &instr,
+                                   const WhileOperand &dst,
+                                   const WhileOperand &val)
+{
+  WhileInstr *i = createInstr(instr.Line, instr.OffsetOnLine, WPLUS, 3);
+  i->Ops[0] = dst;
+  i->Ops[1] = WhileOperand(WIMMEDIATE, 0);
+  i->Ops[2] = val;
+  return i;
+}
+
+WhileInstr &WhileBlock::append(WhileInstr *i)
+{
+  i->Index = Body.size();
+  i->Block = this;
+  Body.push_back(arena(), i);
+  Function->invalidateCode();
+  return *i;
+}
+
+WhileInstr *WhileBlock::createPhi(const WhileOperand &def)
+{
+  unsigned int line = Body.empty() ? 0 : Body.front()->Line;
+  unsigned int offs = Body.empty() ? 0 : Body.front()->OffsetOnLine;
+  WhileInstr *phi = createInstr(line, offs, WPHI, Pred.size() + 1);
+  phi->Index = Phis.size();
+  phi->Block = this;
+  phi->Ops[0] = def;
+  Phis.push_back(arena(), phi);
+  Function->invalidateCode();
+  return phi;
+}
+
+static void addCallSite(WhileInstr *i)
+{
+  if (i->Opc == WCALL && i->Ops[0].ValueOrIndex >= 0)
+  {
+    WhileProgram *p = i->Block->Function->Program;
+    p->FunctionsByIndex.at(i->Ops[0].ValueOrIndex)->CallSites.emplace_back(i);
+  }
+}
+
+static void removeCallSite(WhileInstr *i)
+{
+  if (i->Opc == WCALL && i->Ops[0].ValueOrIndex >= 0)
+  {
+    WhileProgram *p = i->Block->Function->Program;
+    auto &cs = p->FunctionsByIndex.at(i->Ops[0].ValueOrIndex)->CallSites;
+    cs.erase(std::find(cs.begin(), cs.end(), i));
+  }
+}
+
+void WhileBlock::erase(unsigned int idx)
+{
+  WhileInstr *i = Body[idx];
+  removeCallSite(i);
+  Body.erase(Body.begin() + idx);
+  Function->invalidateCode();
+
+  for(unsigned int j = idx; j < Body.size(); j++)
+    Body[j]->Index = j;
+}
+
+WhileInstr &WhileBlock::insert(unsigned int idx, WhileInstr *i)
+{
+  i->Block = this;
+  Body.insert(arena(), Body.begin() + idx, i);
+  addCallSite(i);
+  Function->invalidateCode();
+
+  for(unsigned int j = idx; j < Body.size(); j++)
+    Body[j]->Index = j;
+
+  return *i;
+}
+
+void WhileBlock::replace(unsigned int idx, WhileInstr *i)
+{
+  removeCallSite(Body[idx]);
+  i->Index = idx;
+  i->Block = this;
+  Body[idx] = i;
+  addCallSite(i);
+  Function->invalidateCode();
+}
+
+void WhileBlock::addEdge(WhileSuccKind kind, WhileBlock *succ)
+{
+  assert(!Succ[kind] && "Successor already set");
+  Succ[kind] = succ;
+  succ->Pred.push_back(arena(), WhileEdge{this, kind});
+  Function->invalidateCFG();
+
+  for(WhileInstr *phi : succ->Phis)
+  {
+    WhileOperand *ops = arena().allocateArray<WhileOperand>(phi->Ops.Size + 1);
+    std::copy(phi->Ops.begin(), phi->Ops.end(), ops);
+    phi->Ops.Data = ops;
+    phi->Ops.Size++;
+  }
+}
+
+void WhileBlock::removeEdge(WhileSuccKind kind)
+{
+  WhileBlock *succ = Succ[kind];
+  assert(succ && "No such successor");
+  Succ[kind] = nullptr;
+  Function->invalidateCFG();
+
+  for(auto p = succ->Pred.begin(); p != succ->Pred.end(); p++)
+  {
+    if (p->Block == this && p->Kind == kind)
+    {
+      for(WhileInstr *phi : succ->Phis)
+      {
+        WhileOperand *op = phi->Ops.begin() + (p - succ->Pred.begin()) + 1;
+        std::copy(op + 1, phi->Ops.end(), op);
+        phi->Ops.Size--;
+      }
+
+      succ->Pred.erase(p);
+      return;
+    }
+  }
+  abort();
+}
+
+void WhileBlock::redirectEdge(WhileSuccKind kind, WhileBlock *succ)
+{
+  removeEdge(kind);
+  addEdge(kind, succ);
+
+  if (kind == WBRANCH_TAKEN)
+  {
+    WhileInstr *branch = Body.back();
+    branch->Ops[branch->Opc == WBRANCH ? 0 : 1].ValueOrIndex = succ->Index;
+  }
+}
+
+WhileBlock *WhileFunction::createBlock()
+{
+  Body.emplace_back(Program->Arena.create<WhileBlock>(Body.size(), this));
+  invalidateCFG();
+  return Body.back();
+}
+
+WhileBlock *WhileFunction::createBlockBefore(WhileBlock *bb)
+{
+  WhileBlock *result = createBlock();
+  Body.pop_back();
+  Body.insert(Body.begin() + bb->Index, result);
+  renumber();
+  return result;
+}
+
+void WhileFunction::removeBlocks(const std::vector<bool> &keep)
+{
+  assert(keep.size() == Body.size() && keep[0] && "Entry block is kept");
+
+  for(WhileBlock *bb : Body)
+  {
+    if (keep[bb->Index])
+      continue;
+
+    for(unsigned int kind = WFALL_THROUGH; kind <= WBRANCH_TAKEN; kind++)
+      if (bb->Succ[kind])
+        bb->removeEdge((WhileSuccKind)kind);
+
+    while (!bb->Body.empty())
+      bb->erase(bb->Body.size() - 1);
+  }
+
+  for(WhileBlock *bb : Body)
+  {
+    if (keep[bb->Index])
+      continue;
+
+    while (!bb->Pred.empty())
+      bb->Pred.back().Block->removeEdge(bb->Pred.back().Kind);
+  }
+
+  Body.erase(std::remove_if(Body.begin(), Body.end(),
+                            [&](const WhileBlock *bb) {
+                              return !keep[bb->Index];
+                            }), Body.end());
+  renumber();
+}
+
+void WhileFunction::renumber()
+{
+  invalidateCFG();
+  for(unsigned int idx = 0; idx < Body.size(); idx++)
+    Body[idx]->Index = idx;
+
+  for(WhileBlock *bb : Body)
+  {
+    for(unsigned int idx = 0; idx < bb->Body.size(); idx++)
+      bb->Body[idx]->Index = idx;
+
+    if (!bb->Body.empty())
+    {
+      WhileInstr *last = bb->Body.back();
+      if (last->Opc == WBRANCH)
+        last->Ops[0].ValueOrIndex = bb->Succ[WBRANCH_TAKEN]->Index;
+      else if (last->Opc == WBRANCHZ)
+        last->Ops[1].ValueOrIndex = bb->Succ[WBRANCH_TAKEN]->Index;
+    }
+  }
+}
+
+unsigned int WhileFunction::size() const
+{
+  unsigned int result = 0;
+  for(const WhileBlock *bb : Body)
+    result += bb->Body.size();
+
+  return result;
+}
+
+bool WhileFunction::frameEscapes() const
+{
+  for(const WhileBlock *bb : Body)
+    for(const WhileInstr *instr : bb->Body)
+      for(unsigned int idx = 0; idx < instr->Ops.size(); idx++)
+        if (instr->Ops[idx].Kind == WFRAMEPOINTER &&
+            !(instr->Opc == WLOAD && (idx == 1 || idx == 2)) &&
+            !(instr->Opc == WSTORE && (idx == 0 || idx == 1)))
+          return true;
+
+  return false;
+}
+
+bool WhileFunction::isSSA() const
+{
+  for(const WhileBlock *bb : Body)
+    if (!bb->Phis.empty())
+      return true;
+
+  return false;
+}
+
+std::unique_ptr<WhileProgram> generateCode(antlr4::tree::ParseTree *tree)
 {
   WhileCodeGenListener WCGL;
   antlr4::tree::ParseTreeWalker::DEFAULT.walk(&WCGL, tree);
 
-  return WCGL.Program;
+  return std::move(WCGL.Program);
+}
+
+bool readProfile(WhileProgram &p, std::istream &s)
+{
+  std::string name;
+  unsigned int block;
+  unsigned long count, taken;
+  while (s >> name >> block >> count >> taken)
+  {
+    auto f = p.Functions.find(name);
+    if (f == p.Functions.end() || block >= f->second.Body.size())
+      return false;
+
+    f->second.Body[block]->Count = count;
+    f->second.Body[block]->TakenCount = taken;
+  }
+
+  p.HasProfile = true;
+  return s.eof();
 }
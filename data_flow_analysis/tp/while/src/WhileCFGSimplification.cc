@@ -0,0 +1,246 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements the simplification of the control-flow graph. Edges to
+// empty blocks, blocks consisting of an unconditional branch, and blocks
+// consisting of a conditional branch whose condition is known on the edge, are
+// redirected to the block eventually reached. Conditional branches whose two
+// successors are the same are removed. A block is merged with its successor
+// when it is the only predecessor of the successor. Blocks that are no longer
+// reachable are removed at the end.
+
+#include "WhilePass.h"
+
+#include <algorithm>
+
+struct WhileCFGSimplification : public WhileFunctionPass
+{
+  // Determine the value of the register r at the end of bb, when leaving it by
+  // an edge of the given kind. Only conditions of a final branch and constant
+  // definitions are considered.
+  static bool isKnown(const WhileBlock &bb, WhileSuccKind kind, int r,
+                      bool &nonzero)
+  {
+    for(unsigned int idx = bb.Body.size(); idx-- > 0; )
+    {
+      const WhileInstr *instr = bb.Body[idx];
+      if (instr->Opc == WBRANCHZ && instr->Ops[0].Kind == WREGISTER &&
+          instr->Ops[0].ValueOrIndex == r)
+      {
+        // The fall-through edge is taken when the condition is non-zero.
+        nonzero = kind == WFALL_THROUGH;
+        return true;
+      }
+
+      const WhileOperand *def = instr->def();
+      if (!def || def->ValueOrIndex != r)
+        continue;
+
+      int value;
+      if (instr->Opc < WPLUS || instr->Opc > WLESSEQUAL ||
+          !instr->Ops[1].isImm() || !instr->Ops[2].isImm() ||
+          !evaluateBinary(instr->Opc, instr->Ops[1].ValueOrIndex,
+                          instr->Ops[2].ValueOrIndex, value))
+        return false;
+
+      nonzero = value != 0;
+      return true;
+    }
+
+    return false;
+  }
+
+  // The block eventually reached by the edge from pred to bb, without
+  // executing any instruction, or null.
+  static WhileBlock *forward(const WhileBlock &pred, WhileSuccKind kind,
+                             const WhileBlock &bb)
+  {
+    if (!bb.Phis.empty())
+      return nullptr;
+    else if (bb.Body.empty())
+      return bb.Succ[WFALL_THROUGH];
+    else if (bb.Body.size() != 1)
+      return nullptr;
+
+    const WhileInstr *branch = bb.Body.front();
+    bool nonzero;
+    if (branch->Opc == WBRANCH)
+      return bb.Succ[WBRANCH_TAKEN];
+    else if (branch->Opc == WBRANCHZ && branch->Ops[0].Kind == WREGISTER &&
+             isKnown(pred, kind, branch->Ops[0].ValueOrIndex, nonzero))
+      return bb.Succ[nonzero ? WFALL_THROUGH : WBRANCH_TAKEN];
+
+    return nullptr;
+  }
+
+  // Redirect the successors of bb over blocks that do nothing.
+  static bool thread(WhileBlock *bb)
+  {
+    bool changed = false;
+    for(unsigned int kind = WFALL_THROUGH; kind <= WBRANCH_TAKEN; kind++)
+    {
+      // Bound the walk by the number of blocks, in case of a cycle of empty
+      // blocks.
+      const WhileBlock *from = bb;
+      WhileBlock *target = bb->Succ[kind];
+      WhileSuccKind k = (WhileSuccKind)kind;
+      unsigned int numblocks = bb->Function->Body.size();
+      for(unsigned int n = 0; target && n < numblocks; n++)
+      {
+        WhileBlock *next = forward(*from, k, *target);
+        if (!next || next == target || !next->Phis.empty())
+          break;
+
+        k = next == target->Succ[WFALL_THROUGH] ? WFALL_THROUGH : WBRANCH_TAKEN;
+        from = target;
+        target = next;
+      }
+
+      if (target && target != bb->Succ[kind])
+      {
+        bb->redirectEdge((WhileSuccKind)kind, target);
+        changed = true;
+      }
+    }
+
+    return changed;
+  }
+
+  // Remove a conditional branch whose successors are the same block.
+  static bool foldBranch(WhileBlock *bb)
+  {
+    WhileBlock *succ = bb->Succ[WFALL_THROUGH];
+    if (!succ || succ != bb->Succ[WBRANCH_TAKEN] || !succ->Phis.empty())
+      return false;
+
+    bb->erase(bb->Body.size() - 1);
+    bb->removeEdge(WBRANCH_TAKEN);
+    bb->TakenCount = 0;
+    return true;
+  }
+
+  // Append the instructions of the successor of bb to bb, if bb is its only
+  // predecessor. The successor is left empty and unreachable.
+  static bool merge(WhileBlock *bb)
+  {
+    const WhileInstr *last = bb->Body.empty() ? nullptr : bb->Body.back();
+    bool jump = last && last->Opc == WBRANCH;
+    WhileBlock *succ = bb->Succ[jump ? WBRANCH_TAKEN : WFALL_THROUGH];
+    if (!succ || (!jump && bb->Succ[WBRANCH_TAKEN]) || succ == bb ||
+        succ->isEntry() || succ->Pred.size() != 1 || !succ->Phis.empty())
+      return false;
+
+    if (jump)
+    {
+      bb->erase(last->Index);
+      bb->removeEdge(WBRANCH_TAKEN);
+    }
+    else
+      bb->removeEdge(WFALL_THROUGH);
+
+    while (!succ->Body.empty())
+    {
+      WhileInstr *instr = succ->Body.front();
+      succ->erase(0);
+      bb->insert(bb->Body.size(), instr);
+    }
+
+    // The edges leaving the successor now leave bb, phis keep their operands.
+    for(unsigned int kind = WFALL_THROUGH; kind <= WBRANCH_TAKEN; kind++)
+    {
+      WhileBlock *next = succ->Succ[kind];
+      if (!next)
+        continue;
+
+      std::vector<WhileOperand> values;
+      unsigned int pos = 0;
+      while (next->Pred[pos].Block != succ || next->Pred[pos].Kind != kind)
+        pos++;
+      for(const WhileInstr *phi : next->Phis)
+        values.emplace_back(phi->Ops[pos + 1]);
+
+      succ->removeEdge((WhileSuccKind)kind);
+      bb->addEdge((WhileSuccKind)kind, next);
+      for(unsigned int idx = 0; idx < values.size(); idx++)
+        next->Phis[idx]->Ops[next->Pred.size()] = values[idx];
+    }
+
+    bb->TakenCount = succ->TakenCount;
+    return true;
+  }
+
+  static bool removeUnreachableBlocks(WhileFunction &f)
+  {
+    std::vector<bool> reachable(f.Body.size());
+    std::vector<const WhileBlock*> worklist = {f.Body.front()};
+    reachable[0] = true;
+
+    while (!worklist.empty())
+    {
+      const WhileBlock *bb = worklist.back();
+      worklist.pop_back();
+
+      for(const WhileBlock *succ : bb->Succ)
+      {
+        if (succ && !reachable[succ->Index])
+        {
+          reachable[succ->Index] = true;
+          worklist.emplace_back(succ);
+        }
+      }
+    }
+
+    if (std::find(reachable.begin(), reachable.end(), false) == reachable.end())
+      return false;
+
+    f.removeBlocks(reachable);
+    return true;
+  }
+
+  bool run(WhileFunction &f) override
+  {
+    // Blocks are only emptied while iterating, their indices remain valid.
+    bool changed = false;
+    bool iterate = true;
+    while (iterate)
+    {
+      iterate = false;
+      for(WhileBlock *bb : f.Body)
+      {
+        iterate |= thread(bb);
+        iterate |= foldBranch(bb);
+        iterate |= merge(bb);
+      }
+
+      changed |= iterate;
+    }
+
+    changed |= removeUnreachableBlocks(f);
+    return changed;
+  }
+
+  WhileCFGSimplification() : WhileFunctionPass("simplifycfg",
+                                               "Control-flow graph "
+                                               "simplification", true)
+  {
+  }
+};
+
+WhileCFGSimplification WCFGS;
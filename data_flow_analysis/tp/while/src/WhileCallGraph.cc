@@ -0,0 +1,165 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file implements the construction of the call graph, using Tarjan's
+// algorithm to find its strongly connected components, and the computation of
+// the stack space needed by the frames of a function and its callees.
+
+#include "WhileCallGraph.h"
+
+#include <algorithm>
+#include <utility>
+
+WhileCallGraph::WhileCallGraph(const WhileProgram &p)
+  : Callees(p.FunctionsByIndex.size()), SCCIndex(p.FunctionsByIndex.size())
+{
+  unsigned int n = p.FunctionsByIndex.size();
+  std::vector<bool> self(n);
+  for(const WhileFunction *f : p.FunctionsByIndex)
+  {
+    auto &callees = Callees[f->Index];
+    for(const WhileBlock *bb : f->Body)
+    {
+      for(const WhileInstr *instr : bb->Body)
+      {
+        int callee = instr->Opc == WCALL ? instr->Ops[0].ValueOrIndex : -1;
+        if (callee < 0)
+          continue;
+
+        WhileFunction *g = p.FunctionsByIndex[callee];
+        if (std::find(callees.begin(), callees.end(), g) == callees.end())
+          callees.emplace_back(g);
+
+        self[f->Index] = self[f->Index] || g == f;
+      }
+    }
+  }
+
+  // Tarjan's algorithm, the stack of the traversal holds the next callee to
+  // visit. Components are completed after all components they call.
+  const unsigned int unvisited = -1;
+  std::vector<unsigned int> number(n, unvisited);
+  std::vector<unsigned int> lowlink(n);
+  std::vector<bool> onstack(n);
+  std::vector<WhileFunction*> members;
+  unsigned int next = 0;
+  for(WhileFunction *root : p.FunctionsByIndex)
+  {
+    if (number[root->Index] != unvisited)
+      continue;
+
+    std::vector<std::pair<WhileFunction*, unsigned int> > stack;
+    stack.emplace_back(root, 0);
+    number[root->Index] = lowlink[root->Index] = next++;
+    members.emplace_back(root);
+    onstack[root->Index] = true;
+    while (!stack.empty())
+    {
+      auto &[f, callee] = stack.back();
+      if (callee < Callees[f->Index].size())
+      {
+        WhileFunction *g = Callees[f->Index][callee++];
+        if (number[g->Index] == unvisited)
+        {
+          number[g->Index] = lowlink[g->Index] = next++;
+          members.emplace_back(g);
+          onstack[g->Index] = true;
+          stack.emplace_back(g, 0);
+        }
+        else if (onstack[g->Index])
+          lowlink[f->Index] = std::min(lowlink[f->Index], number[g->Index]);
+
+        continue;
+      }
+
+      WhileFunction *done = f;
+      stack.pop_back();
+      if (!stack.empty())
+      {
+        unsigned int caller = stack.back().first->Index;
+        lowlink[caller] = std::min(lowlink[caller], lowlink[done->Index]);
+      }
+
+      if (lowlink[done->Index] != number[done->Index])
+        continue;
+
+      std::vector<WhileFunction*> scc;
+      WhileFunction *member = nullptr;
+      while (member != done)
+      {
+        member = members.back();
+        members.pop_back();
+        onstack[member->Index] = false;
+        SCCIndex[member->Index] = SCCs.size();
+        scc.emplace_back(member);
+      }
+
+      Recursive.emplace_back(scc.size() > 1 || self[done->Index]);
+      SCCs.emplace_back(std::move(scc));
+    }
+  }
+}
+
+// The slots of a frame, including those of parameters passed in memory.
+static unsigned int frameSize(const WhileFunction &f)
+{
+  unsigned int result = f.FrameSize;
+  for(unsigned int idx = 0; idx < f.ParameterRegisters.size(); idx++)
+    if (f.ParameterRegisters[idx] < 0)
+      result = std::max(result, idx + 1);
+
+  return result;
+}
+
+long WhileCallGraph::stackDepth(const WhileFunction &f,
+                                unsigned int recursion) const
+{
+  // Components are visited callees first, the depth of a component is the
+  // largest frame of its members, once for each active call in the component,
+  // followed by the deepest component called.
+  std::vector<long> depth(SCCs.size());
+  for(unsigned int c = 0; c <= SCCIndex[f.Index]; c++)
+  {
+    long frame = 0;
+    long callees = 0;
+    for(const WhileFunction *member : SCCs[c])
+    {
+      frame = std::max(frame, (long)frameSize(*member));
+      for(const WhileFunction *g : Callees[member->Index])
+      {
+        unsigned int callee = SCCIndex[g->Index];
+        if (callee == c)
+          continue;
+        else if (depth[callee] < 0)
+          callees = -1;
+        else if (callees >= 0)
+          callees = std::max(callees, depth[callee]);
+      }
+    }
+
+    if (callees < 0 || (Recursive[c] && !recursion))
+      depth[c] = -1;
+    else
+      depth[c] = frame * (Recursive[c] ? recursion : 1) + callees;
+  }
+
+  return depth[SCCIndex[f.Index]];
+}
@@ -0,0 +1,137 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements constant propagation and folding. A data-flow analysis
+// tracks registers holding a single constant value, uses of those registers are
+// replaced by immediates, instructions with constant operands are folded, and
+// statically decided conditional branches are simplified.
+
+#include "WhileConstAnalysis.h"
+#include "WhilePass.h"
+
+struct WhileConstantPropagation : public WhileFunctionPass
+{
+  // Replace register operands holding a constant by immediates. The symbol of
+  // the register is dropped, it does not describe the constant.
+  static bool propagate(WhileInstr &instr, const WhileConstDomain &input)
+  {
+    bool changed = false;
+    for(unsigned int idx = 0; idx < instr.Ops.size(); idx++)
+    {
+      WhileOperand &op = instr.Ops[idx];
+      if (op.Kind != WREGISTER || !instr.isUse(idx))
+        continue;
+
+      WhileConstValue value = WhileConstAnalysis::readDataOperand(op, input);
+      if (value.Kind == WhileConstValue::CONSTANT)
+      {
+        op.Kind = WIMMEDIATE;
+        op.ValueOrIndex = value.Value;
+        op.Symbol = nullptr;
+        changed = true;
+      }
+    }
+
+    return changed;
+  }
+
+  // Turn pure instructions with constant operands into moves of the constant,
+  // i.e., OpD = 0 + Constant.
+  static bool fold(WhileInstr &instr)
+  {
+    if (!instr.isPure() || !instr.Ops[1].isImm() || !instr.Ops[2].isImm() ||
+        (instr.Opc == WPLUS && instr.Ops[1].isZero()))
+      return false;
+
+    int result;
+    if (!evaluateBinary(instr.Opc, instr.Ops[1].ValueOrIndex,
+                        instr.Ops[2].ValueOrIndex, result))
+      return false;
+
+    instr.Opc = WPLUS;
+    instr.Ops[1] = WhileOperand(WIMMEDIATE, 0);
+    instr.Ops[2] = WhileOperand(WIMMEDIATE, result);
+    return true;
+  }
+
+  // Replace a conditional branch on a constant by an unconditional branch, or
+  // remove it when it is never taken.
+  static bool simplifyBranch(WhileBlock &bb)
+  {
+    if (bb.Body.empty())
+      return false;
+
+    WhileInstr &branch = *bb.Body.back();
+    if (branch.Opc != WBRANCHZ || !branch.Ops[0].isImm())
+      return false;
+
+    if (branch.Ops[0].ValueOrIndex == 0)
+    {
+      WhileInstr *jump = bb.createInstr(branch.Line, branch.OffsetOnLine,
+                                        WBRANCH, 1);
+      jump->Ops[0] = branch.Ops[1];
+      bb.replace(branch.Index, jump);
+      bb.removeEdge(WFALL_THROUGH);
+      bb.TakenCount = bb.Count;
+    }
+    else
+    {
+      bb.erase(branch.Index);
+      bb.removeEdge(WBRANCH_TAKEN);
+      bb.TakenCount = 0;
+    }
+
+    return true;
+  }
+
+  bool run(WhileFunction &f) override
+  {
+    WhileConstAnalysis WCA;
+    WCA.initialize(f);
+    WCA.iterate();
+
+    bool changed = false;
+    for(WhileBlock *bb : f.Body)
+    {
+      WhileConstDomain state(WCA.join(bb));
+      for(WhileInstr *instr : bb->Body)
+      {
+        WhileConstDomain next(WCA.transfer(*instr, state));
+        changed |= propagate(*instr, state);
+        changed |= fold(*instr);
+        state = std::move(next);
+      }
+
+      changed |= simplifyBranch(*bb);
+    }
+
+    if (changed)
+      f.invalidateCode();
+
+    return changed;
+  }
+
+  WhileConstantPropagation() : WhileFunctionPass("constprop",
+                                                 "Constant propagation and folding")
+  {
+  }
+};
+
+WhileConstantPropagation WCP;
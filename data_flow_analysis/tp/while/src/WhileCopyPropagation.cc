@@ -0,0 +1,310 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements copy propagation and move coalescing. Temporaries that
+// are only copied into a variable are computed directly into the variable,
+// uses of copied registers are replaced by the source of the copy when it is
+// available on all paths, and copies that are no longer live are removed.
+
+#include "WhileAnalysis.h"
+#include "WhilePass.h"
+#include "WhileLiveness.h"
+
+struct WhileCopyDomain
+{
+  // Blocks not yet reached make no statement about copies.
+  bool Top = true;
+
+  // Destination register of each available copy, mapped to its source.
+  std::map<int, int> Copies;
+
+  bool operator!=(const WhileCopyDomain &o) const
+  {
+    return Top != o.Top || Copies != o.Copies;
+  }
+};
+
+struct WhileCopyAnalysis : public WhileDataFlowAnalysis<WhileCopyDomain>
+{
+  using WhileDataFlowAnalysis<WhileCopyDomain>::join;
+
+  WhileCopyDomain join(const WhileBlock *bb) override
+  {
+    std::list<WhileCopyDomain> bbIn;
+    if (bb->isEntry())
+      bbIn.emplace_back(WhileCopyDomain{false, {}});
+
+    for(const auto &[pred, kind] : bb->Pred)
+      bbIn.emplace_back(BBOut[pred]);
+
+    return join(bbIn);
+  }
+
+  // A copy is available when it is available on all incoming paths.
+  WhileCopyDomain join(std::list<WhileCopyDomain> inputs) override
+  {
+    WhileCopyDomain result;
+    for(const WhileCopyDomain &input : inputs)
+    {
+      if (input.Top)
+        continue;
+      else if (result.Top)
+        result = input;
+      else
+      {
+        for(auto c = result.Copies.begin(); c != result.Copies.end(); )
+        {
+          auto other = input.Copies.find(c->first);
+          if (other == input.Copies.end() || other->second != c->second)
+            c = result.Copies.erase(c);
+          else
+            c++;
+        }
+      }
+    }
+
+    return result;
+  }
+
+  WhileCopyDomain transfer(const WhileInstr &instr,
+                           const WhileCopyDomain input) override
+  {
+    const WhileOperand *def = instr.def();
+    if (!def || input.Top)
+      return input;
+
+    WhileCopyDomain result = input;
+    int r = def->ValueOrIndex;
+    for(auto c = result.Copies.begin(); c != result.Copies.end(); )
+    {
+      if (c->first == r || c->second == r)
+        c = result.Copies.erase(c);
+      else
+        c++;
+    }
+
+    if (instr.isCopy() && instr.Ops[2].ValueOrIndex != r)
+      result.Copies[r] = instr.Ops[2].ValueOrIndex;
+
+    return result;
+  }
+
+  std::ostream &dump_first(std::ostream &s,
+                           const WhileCopyDomain &value) override
+  {
+    if (value.Top)
+      return s << "    ⊤\n";
+
+    s << "    [";
+    bool first = true;
+    for(const auto&[dst, src] : value.Copies)
+    {
+      if (!first)
+        s << ", ";
+
+      s << "R" << dst << "=R" << src;
+      first = false;
+    }
+    return s << "]\n";
+  }
+
+  std::ostream &dump_pre(std::ostream &s,
+                         const WhileCopyDomain &value) override
+  {
+    return s;
+  }
+
+  std::ostream &dump_post(std::ostream &s,
+                          const WhileCopyDomain &value) override
+  {
+    return dump_first(s, value);
+  }
+};
+
+struct WhileCopyPropagation : public WhileFunctionPass
+{
+  static bool readsOrWrites(const WhileInstr &instr, int r)
+  {
+    for(const WhileOperand &op : instr.Ops)
+      if (op.Kind == WREGISTER && op.ValueOrIndex == r)
+        return true;
+
+    return false;
+  }
+
+  // Find the definition of the temporary copied by the move at position idx of
+  // bb, walking backwards through blocks with a single predecessor that falls
+  // through into them. The destination of the move must not be accessed in
+  // between.
+  static WhileInstr *findCoalescable(WhileBlock *bb, unsigned int idx)
+  {
+    const WhileInstr &move = *bb->Body[idx];
+    int dst = move.Ops[0].ValueOrIndex;
+    int tmp = move.Ops[2].ValueOrIndex;
+
+    const WhileBlock *start = bb;
+    while (true)
+    {
+      while (idx-- > 0)
+      {
+        WhileInstr *instr = bb->Body[idx];
+        const WhileOperand *def = instr->def();
+        if (def && def->Kind == WREGISTER && def->ValueOrIndex == tmp)
+          return instr;
+        else if (readsOrWrites(*instr, dst))
+          return nullptr;
+      }
+
+      if (bb->Pred.size() != 1 || bb->Pred[0].Block == start ||
+          bb->Pred[0].Block->Succ[WBRANCH_TAKEN])
+        return nullptr;
+
+      bb = bb->Pred[0].Block;
+      idx = bb->Body.size();
+    }
+  }
+
+  // Compute temporaries, defined and used exactly once, directly into the
+  // register they are copied to.
+  static bool coalesce(WhileFunction &f)
+  {
+    std::vector<unsigned int> numDefs(f.NumRegisters);
+    std::vector<unsigned int> numUses(f.NumRegisters);
+    for(const WhileBlock *bb : f.Body)
+    {
+      for(const WhileInstr *instr : bb->Body)
+      {
+        for(unsigned int idx = 0; idx < instr->Ops.size(); idx++)
+        {
+          const WhileOperand &op = instr->Ops[idx];
+          if (op.Kind != WREGISTER)
+            continue;
+          else if (instr->isUse(idx))
+            numUses[op.ValueOrIndex]++;
+          else
+            numDefs[op.ValueOrIndex]++;
+        }
+      }
+    }
+
+    bool changed = false;
+    for(WhileBlock *bb : f.Body)
+    {
+      for(unsigned int idx = 0; idx < bb->Body.size(); )
+      {
+        const WhileInstr &move = *bb->Body[idx];
+        WhileInstr *def = nullptr;
+        if (move.isCopy() && numDefs[move.Ops[2].ValueOrIndex] == 1 &&
+            numUses[move.Ops[2].ValueOrIndex] == 1)
+          def = findCoalescable(bb, idx);
+
+        if (def)
+        {
+          numDefs[move.Ops[2].ValueOrIndex] = 0;
+          numUses[move.Ops[2].ValueOrIndex] = 0;
+          *def->def() = move.Ops[0];
+          bb->erase(idx);
+          changed = true;
+        }
+        else
+          idx++;
+      }
+    }
+
+    return changed;
+  }
+
+  // Replace uses of copied registers by the source of the copy.
+  static bool propagate(WhileFunction &f)
+  {
+    WhileCopyAnalysis WCA;
+    WCA.initialize(f);
+    WCA.iterate();
+
+    bool changed = false;
+    for(WhileBlock *bb : f.Body)
+    {
+      WhileCopyDomain state(WCA.join(bb));
+      for(WhileInstr *instr : bb->Body)
+      {
+        for(unsigned int idx = 0; idx < instr->Ops.size() && !state.Top; idx++)
+        {
+          WhileOperand &op = instr->Ops[idx];
+          if (op.Kind != WREGISTER || !instr->isUse(idx))
+            continue;
+
+          auto copy = state.Copies.find(op.ValueOrIndex);
+          if (copy != state.Copies.end())
+          {
+            op.ValueOrIndex = copy->second;
+            changed = true;
+          }
+        }
+
+        state = WCA.transfer(*instr, state);
+      }
+    }
+
+    if (changed)
+      f.invalidateCode();
+
+    return changed;
+  }
+
+  // Remove copies whose destination is not live, including self-copies.
+  static bool removeDeadCopies(WhileFunction &f)
+  {
+    bool changed = false;
+    WhileLiveness WL(f);
+    for(WhileBlock *bb : f.Body)
+    {
+      WhileRegisterSet live = WL.LiveOut[bb->Index];
+      for(unsigned int idx = bb->Body.size(); idx-- > 0; )
+      {
+        const WhileInstr &i = *bb->Body[idx];
+        if (i.isCopy() && (!live[i.Ops[0].ValueOrIndex] ||
+                           i.Ops[2].ValueOrIndex == i.Ops[0].ValueOrIndex))
+        {
+          bb->erase(idx);
+          changed = true;
+        }
+        else
+          WhileLiveness::transfer(i, live);
+      }
+    }
+
+    return changed;
+  }
+
+  bool run(WhileFunction &f) override
+  {
+    bool changed = coalesce(f);
+    changed |= propagate(f);
+    changed |= removeDeadCopies(f);
+    return changed;
+  }
+
+  WhileCopyPropagation() : WhileFunctionPass("copyprop",
+                                             "Copy propagation and move coalescing")
+  {
+  }
+};
+
+WhileCopyPropagation WCOPY;
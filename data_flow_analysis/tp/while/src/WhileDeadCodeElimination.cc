@@ -0,0 +1,120 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements dead code elimination. Blocks that are not reachable
+// from the entry block are removed, as well as instructions without side
+// effects whose result is not used, directly or transitively, by instructions
+// with side effects.
+
+#include "WhilePass.h"
+#include "WhileDefUse.h"
+
+#include <unordered_set>
+
+struct WhileDeadCodeElimination : public WhileFunctionPass
+{
+  static bool removeUnreachableBlocks(WhileFunction &f)
+  {
+    std::vector<bool> reachable(f.Body.size());
+    std::vector<const WhileBlock*> worklist = {f.Body.front()};
+    reachable[0] = true;
+
+    while (!worklist.empty())
+    {
+      const WhileBlock *bb = worklist.back();
+      worklist.pop_back();
+
+      for(const WhileBlock *succ : bb->Succ)
+      {
+        if (succ && !reachable[succ->Index])
+        {
+          reachable[succ->Index] = true;
+          worklist.emplace_back(succ);
+        }
+      }
+    }
+
+    if (std::find(reachable.begin(), reachable.end(), false) == reachable.end())
+      return false;
+
+    f.removeBlocks(reachable);
+    return true;
+  }
+
+  // Instructions with side effects are needed, as well as the definitions
+  // reaching their operands, transitively. The other instructions are removed,
+  // including cycles of definitions only used by themselves.
+  static bool removeDeadInstructions(WhileFunction &f)
+  {
+    WhileDefUse &DU = f.defUse();
+    std::unordered_set<const WhileInstr*> needed;
+    std::vector<const WhileInstr*> worklist;
+    for(const WhileBlock *bb : f.Body)
+    {
+      for(const WhileInstr *phi : bb->Phis)
+        worklist.emplace_back(phi);
+
+      for(const WhileInstr *instr : bb->Body)
+        if (instr->hasSideEffects())
+          worklist.emplace_back(instr);
+    }
+    needed.insert(worklist.begin(), worklist.end());
+
+    while (!worklist.empty())
+    {
+      const WhileInstr *instr = worklist.back();
+      worklist.pop_back();
+
+      for(auto u = DU.usesBegin(*instr); u != DU.usesEnd(*instr); u++)
+        for(const WhileInstr *def : u->Defs)
+          if (def && needed.insert(def).second)
+            worklist.emplace_back(def);
+    }
+
+    bool changed = false;
+    for(WhileBlock *bb : f.Body)
+    {
+      for(unsigned int idx = bb->Body.size(); idx-- > 0; )
+      {
+        if (!needed.count(bb->Body[idx]))
+        {
+          DU.erase(bb->Body[idx]);
+          changed = true;
+        }
+      }
+    }
+
+    return changed;
+  }
+
+  bool run(WhileFunction &f) override
+  {
+    bool changed = removeUnreachableBlocks(f);
+    changed |= removeDeadInstructions(f);
+    return changed;
+  }
+
+  WhileDeadCodeElimination() : WhileFunctionPass("dce",
+                                                 "Dead code elimination", true)
+  {
+  }
+};
+
+WhileDeadCodeElimination WDCE;
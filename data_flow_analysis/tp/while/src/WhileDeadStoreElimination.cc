@@ -0,0 +1,289 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file implements dead store elimination. A backward liveness analysis of
+// memory locations, i.e., the slots of the frame and the globals, finds stores
+// to a known location that is overwritten or left before being read. Addresses
+// are known when all definitions reaching the address operands of an access
+// compute the same frame or global address. Other accesses may read any
+// location their address may point to according to the points-to analysis, as
+// well as any global.
+
+#include "WhilePass.h"
+#include "WhileDefUse.h"
+#include "WhilePointsTo.h"
+
+struct WhileDeadStoreElimination : public WhilePass
+{
+  typedef std::vector<bool> WhileLocationSet;
+
+  // A value known to be an integer or an offset from the frame pointer.
+  struct Value
+  {
+    enum { INTEGER, FRAME, UNKNOWN } Kind = UNKNOWN;
+    int Offset = 0;
+  };
+
+  struct MemoryInfo
+  {
+    const WhileFunction &F;
+    const WhileDefUse &DU;
+    const WhilePointsTo &PTA;
+
+    // Frame slots come first, followed by the globals.
+    unsigned int NumLocations;
+
+    // The locations that may be accessed by callees, i.e., the globals and
+    // escaping frame slots.
+    WhileLocationSet Escaping;
+
+    MemoryInfo(const WhileFunction &f, const WhilePointsTo &pta)
+      : F(f), DU(f.defUse()), PTA(pta),
+        NumLocations(f.FrameSize + f.Program->DataSize),
+        Escaping(NumLocations)
+    {
+      for(unsigned int g = f.FrameSize; g < NumLocations; g++)
+        Escaping[g] = true;
+
+      computeEscaping();
+    }
+
+    // The frame slots of the abstract locations in the set, slots outside of
+    // all frame objects are always included.
+    WhileLocationSet slots(const WhileBitSet &locs) const
+    {
+      WhileLocationSet result(NumLocations);
+      WhileLocationSet covered(F.FrameSize);
+      for(const WhileFrameObject &obj : F.FrameObjects)
+      {
+        bool contained = locs.contains(PTA.LocationIndex.at(obj.Symbol));
+        for(unsigned int s = obj.Offset; s < obj.Offset + obj.Size; s++)
+        {
+          result[s] = result[s] || contained;
+          covered[s] = true;
+        }
+      }
+
+      for(unsigned int s = 0; s < F.FrameSize; s++)
+        result[s] = result[s] || !covered[s];
+
+      return result;
+    }
+
+    static bool merge(WhileLocationSet &a, const WhileLocationSet &b)
+    {
+      bool changed = false;
+      for(unsigned int l = 0; l < a.size(); l++)
+      {
+        if (b[l] && !a[l])
+        {
+          a[l] = true;
+          changed = true;
+        }
+      }
+
+      return changed;
+    }
+
+    // Frame slots escape when their address is stored to memory, passed to a
+    // call, or returned.
+    void computeEscaping()
+    {
+      merge(Escaping, slots(PTA.Escaping));
+    }
+
+    // The value of operand idx of the instruction, if all definitions reaching
+    // it compute the same integer or frame address.
+    Value value(const WhileInstr &instr, unsigned int idx) const
+    {
+      const WhileOperand &op = instr.Ops[idx];
+      Value result;
+      if (op.isImm())
+      {
+        result.Kind = Value::INTEGER;
+        result.Offset = op.ValueOrIndex;
+        return result;
+      }
+      else if (op.Kind == WFRAMEPOINTER)
+      {
+        result.Kind = Value::FRAME;
+        return result;
+      }
+      else if (op.Kind != WREGISTER)
+        return result;
+
+      bool first = true;
+      for(const WhileInstr *def : DU.defs(instr, idx))
+      {
+        // Values on entry and values computed otherwise are unknown.
+        if (!def || def->Opc != WPLUS || def->Ops[1].Kind == WREGISTER ||
+            def->Ops[2].Kind == WREGISTER)
+          return Value();
+
+        Value a = value(*def, 1);
+        Value b = value(*def, 2);
+        Value v;
+        v.Kind = a.Kind == Value::FRAME ? Value::FRAME : b.Kind;
+        v.Offset = a.Offset + b.Offset;
+        if (a.Kind == Value::FRAME && b.Kind == Value::FRAME)
+          return Value();
+        else if (!first && (v.Kind != result.Kind || v.Offset != result.Offset))
+          return Value();
+
+        result = v;
+        first = false;
+      }
+
+      return first ? Value() : result;
+    }
+
+    // The location accessed by a load or store, or -1 if it is not known.
+    int location(const WhileInstr &instr) const
+    {
+      unsigned int base = instr.Opc == WLOAD ? 1 : 0;
+      Value a = value(instr, base);
+      Value b = value(instr, base + 1);
+      if (a.Kind == Value::UNKNOWN || b.Kind == Value::UNKNOWN ||
+          (a.Kind == Value::FRAME && b.Kind == Value::FRAME))
+        return -1;
+
+      long addr = (long)a.Offset + b.Offset;
+      if (a.Kind == Value::FRAME || b.Kind == Value::FRAME)
+        return addr >= 0 && addr < F.FrameSize ? addr : -1;
+
+      return addr >= 0 && addr < F.Program->DataSize ? F.FrameSize + addr : -1;
+    }
+
+    // The locations that may be accessed by a load or store of unknown
+    // address, i.e., the frame slots its address may point to, and any global.
+    WhileLocationSet mayAccess(const WhileInstr &instr) const
+    {
+      WhileLocationSet result = slots(PTA.accessed(instr));
+      for(unsigned int g = F.FrameSize; g < NumLocations; g++)
+        result[g] = true;
+
+      return result;
+    }
+
+    // Update the live locations before the instruction, given those after it.
+    void transfer(const WhileInstr &instr, WhileLocationSet &live) const
+    {
+      switch (instr.Opc)
+      {
+        case WLOAD:
+        {
+          int loc = location(instr);
+          if (loc >= 0)
+            live[loc] = true;
+          else
+            merge(live, mayAccess(instr));
+          break;
+        }
+        case WSTORE:
+        {
+          int loc = location(instr);
+          if (loc >= 0)
+            live[loc] = false;
+          break;
+        }
+        case WCALL:
+        case WRETURN:
+          merge(live, Escaping);
+          break;
+        default:
+          break;
+      }
+    }
+  };
+
+  bool run(WhileFunction &f, const WhilePointsTo &PTA)
+  {
+    MemoryInfo MI(f, PTA);
+    std::vector<WhileLocationSet> liveIn(f.Body.size(),
+                                         WhileLocationSet(MI.NumLocations));
+    std::vector<WhileLocationSet> liveOut = liveIn;
+
+    bool changed = true;
+    while (changed)
+    {
+      changed = false;
+      for(auto bb = f.Body.rbegin(); bb != f.Body.rend(); bb++)
+      {
+        WhileLocationSet &out = liveOut[(*bb)->Index];
+        for(const WhileBlock *succ : (*bb)->Succ)
+          if (succ)
+            MemoryInfo::merge(out, liveIn[succ->Index]);
+
+        WhileLocationSet live = out;
+        for(unsigned int idx = (*bb)->Body.size(); idx-- > 0; )
+          MI.transfer(*(*bb)->Body[idx], live);
+
+        if (live != liveIn[(*bb)->Index])
+        {
+          liveIn[(*bb)->Index] = std::move(live);
+          changed = true;
+        }
+      }
+    }
+
+    // Collect the dead stores first, removing them updates the chains used to
+    // compute the addresses.
+    std::vector<WhileInstr*> dead;
+    for(WhileBlock *bb : f.Body)
+    {
+      WhileLocationSet live = liveOut[bb->Index];
+      for(unsigned int idx = bb->Body.size(); idx-- > 0; )
+      {
+        WhileInstr *instr = bb->Body[idx];
+        int loc = instr->Opc == WSTORE ? MI.location(*instr) : -1;
+        if (loc >= 0 && !live[loc])
+          dead.emplace_back(instr);
+
+        MI.transfer(*instr, live);
+      }
+    }
+
+    WhileDefUse &DU = f.defUse();
+    for(WhileInstr *store : dead)
+      DU.erase(store);
+
+    return !dead.empty();
+  }
+
+  // The points-to sets are computed once for the whole program. Removing
+  // stores only removes constraints, the sets remain conservative.
+  bool run(WhileProgram &p) override
+  {
+    WhilePointsTo PTA(p);
+    bool changed = false;
+    for(WhileFunction *f : p.FunctionsByIndex)
+      if (accepts(*f))
+        changed |= run(*f, PTA);
+
+    return changed;
+  }
+
+  WhileDeadStoreElimination() : WhilePass("dse", "Dead store elimination")
+  {
+  }
+};
+
+WhileDeadStoreElimination WDSE;
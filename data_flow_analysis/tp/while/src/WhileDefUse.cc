@@ -0,0 +1,267 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file implements the computation of def-use chains, and their updates.
+// The definitions of each register are propagated sparsely, only to the blocks
+// where the register is live. The chains are cached on the functions.
+
+#include "WhileDefUse.h"
+#include "WhileDominators.h"
+#include "WhileLiveness.h"
+
+#include <algorithm>
+#include <cassert>
+
+WhileDefUse::WhileDefUse(const WhileFunction &f)
+  : F(f), Version(f.CodeVersion), EntryUses(f.NumRegisters)
+{
+  // Number the definitions in program order, the definitions reaching a use
+  // are listed in this order, the value on entry first. Keep the last
+  // definition of each register in each block.
+  std::unordered_map<const WhileInstr*, unsigned int> ids;
+  std::vector<std::unordered_map<unsigned int, WhileInstr*> >
+    last(f.Body.size());
+
+  auto record = [&](WhileInstr *instr) {
+    InstrInfo &info = Instrs[instr];
+    info.FirstUse = UseInfos.size();
+    for(unsigned int idx = 0; idx < instr->Ops.size(); idx++)
+    {
+      const WhileOperand &op = instr->Ops[idx];
+      if (op.Kind == WREGISTER && instr->isUse(idx))
+        UseInfos.push_back(UseInfo{{instr, idx}, (unsigned int)op.ValueOrIndex,
+                                   {}});
+    }
+    info.NumUses = UseInfos.size() - info.FirstUse;
+
+    const WhileOperand *def = instr->def();
+    if (def)
+    {
+      info.Def = def->ValueOrIndex;
+      ids.emplace(instr, ids.size());
+      last[instr->Block->Index][info.Def] = instr;
+    }
+  };
+
+  for(const WhileBlock *bb : f.Body)
+  {
+    for(WhileInstr *phi : bb->Phis)
+      record(phi);
+    for(WhileInstr *instr : bb->Body)
+      record(instr);
+  }
+
+  // Propagate the definitions of each register to the beginning of the blocks
+  // where the register is live, from the block defining it and through the
+  // blocks not redefining it. Only the definitions of live registers are thus
+  // kept for each block.
+  typedef std::unordered_map<unsigned int, std::vector<WhileInstr*> > Reaching;
+  struct Fact
+  {
+    const WhileBlock *Block;
+    unsigned int Register;
+    WhileInstr *Def;
+  };
+
+  WhileLiveness WL(f);
+  std::vector<Reaching> in(f.Body.size());
+  std::vector<Fact> worklist;
+  auto reach = [&](const WhileBlock *bb, unsigned int r, WhileInstr *def) {
+    if (!WL.LiveIn[bb->Index][r])
+      return;
+
+    std::vector<WhileInstr*> &defs = in[bb->Index][r];
+    if (std::find(defs.begin(), defs.end(), def) == defs.end())
+    {
+      defs.emplace_back(def);
+      worklist.push_back(Fact{bb, r, def});
+    }
+  };
+
+  auto leave = [&](const WhileBlock *bb, unsigned int r, WhileInstr *def) {
+    for(const WhileBlock *succ : bb->Succ)
+      if (succ)
+        reach(succ, r, def);
+  };
+
+  const std::vector<WhileBlock*> &order = f.dominators().ReversePostOrder;
+  for(unsigned int r = 0; r < f.NumRegisters; r++)
+    reach(order.front(), r, nullptr);
+  for(const WhileBlock *bb : order)
+    for(const auto &[r, def] : last[bb->Index])
+      leave(bb, r, def);
+
+  while (!worklist.empty())
+  {
+    Fact fact = worklist.back();
+    worklist.pop_back();
+    if (!last[fact.Block->Index].count(fact.Register))
+      leave(fact.Block, fact.Register, fact.Def);
+  }
+
+  // Link each use to the definitions of its register reaching it.
+  auto link = [&](UseInfo &use, const Reaching &reaching) {
+    auto defs = reaching.find(use.Register);
+    if (defs == reaching.end())
+      return;
+
+    use.Defs = defs->second;
+    std::sort(use.Defs.begin(), use.Defs.end(),
+              [&](const WhileInstr *a, const WhileInstr *b) {
+                return b && (!a || ids.at(a) < ids.at(b));
+              });
+    for(WhileInstr *def : use.Defs)
+    {
+      if (def)
+        Instrs[def].Reached.emplace_back(use.Use);
+      else
+        EntryUses[use.Register].emplace_back(use.Use);
+    }
+  };
+
+  for(const WhileBlock *bb : order)
+  {
+    Reaching reaching = in[bb->Index];
+    for(WhileInstr *phi : bb->Phis)
+      reaching[Instrs[phi].Def] = {phi};
+
+    for(WhileInstr *instr : bb->Body)
+    {
+      const InstrInfo &info = Instrs[instr];
+      for(unsigned int u = info.FirstUse; u < info.FirstUse + info.NumUses; u++)
+        link(UseInfos[u], reaching);
+
+      if (info.Def >= 0)
+        reaching[info.Def] = {instr};
+    }
+
+    for(unsigned int kind = WFALL_THROUGH; kind <= WBRANCH_TAKEN; kind++)
+    {
+      const WhileBlock *succ = bb->Succ[kind];
+      if (!succ)
+        continue;
+
+      for(unsigned int p = 0; p < succ->Pred.size(); p++)
+      {
+        if (succ->Pred[p].Block != bb || succ->Pred[p].Kind != kind)
+          continue;
+
+        for(const WhileInstr *phi : succ->Phis)
+        {
+          const InstrInfo &info = Instrs[phi];
+          for(unsigned int u = info.FirstUse;
+              u < info.FirstUse + info.NumUses; u++)
+            if (UseInfos[u].Use.Operand == p + 1)
+              link(UseInfos[u], reaching);
+        }
+      }
+    }
+  }
+}
+
+const std::vector<WhileInstr*> &WhileDefUse::defs(const WhileInstr &instr,
+                                                  unsigned int idx) const
+{
+  for(const UseInfo *u = usesBegin(instr); u != usesEnd(instr); u++)
+    if (u->Use.Operand == idx)
+      return u->Defs;
+
+  assert(false && "Operand is not a use of a register.");
+  abort();
+}
+
+void WhileDefUse::unlink(UseInfo &use)
+{
+  for(const WhileInstr *def : use.Defs)
+  {
+    std::vector<WhileUse> &reached = def ? Instrs.at(def).Reached :
+                                           EntryUses[use.Register];
+    reached.erase(std::find_if(reached.begin(), reached.end(),
+                               [&](const WhileUse &u) {
+                                 return u.Instr == use.Use.Instr &&
+                                        u.Operand == use.Use.Operand;
+                               }));
+  }
+
+  use.Defs.clear();
+}
+
+void WhileDefUse::replaceUse(WhileInstr *instr, unsigned int idx,
+                             const WhileOperand &op)
+{
+  assert(Version == F.CodeVersion && "Def-use chains are out of date.");
+  assert(op.Kind != WREGISTER && "Uses of registers cannot be added.");
+
+  // Move the use to the end of the uses of the instruction, then drop it.
+  InstrInfo &info = Instrs.at(instr);
+  UseInfo *first = UseInfos.data() + info.FirstUse;
+  UseInfo *last = first + info.NumUses;
+  UseInfo *use = std::find_if(first, last, [&](const UseInfo &u) {
+                                return u.Use.Operand == idx;
+                              });
+  assert(use != last && "Operand is not a use of a register.");
+
+  unlink(*use);
+  std::swap(*use, *(last - 1));
+  info.NumUses--;
+  instr->Ops[idx] = op;
+}
+
+void WhileDefUse::erase(WhileInstr *instr)
+{
+  assert(Version == F.CodeVersion && "Def-use chains are out of date.");
+  assert(instr->Opc != WPHI && "Phis cannot be erased.");
+
+  // Uses reached by the result lose the definition, they have to be removed
+  // as well.
+  InstrInfo &info = Instrs.at(instr);
+  for(const WhileUse &reached : info.Reached)
+  {
+    InstrInfo &user = Instrs.at(reached.Instr);
+    for(unsigned int u = user.FirstUse; u < user.FirstUse + user.NumUses; u++)
+    {
+      std::vector<WhileInstr*> &defs = UseInfos[u].Defs;
+      if (UseInfos[u].Use.Operand == reached.Operand)
+        defs.erase(std::find(defs.begin(), defs.end(), instr));
+    }
+  }
+
+  for(unsigned int u = info.FirstUse; u < info.FirstUse + info.NumUses; u++)
+    unlink(UseInfos[u]);
+
+  Instrs.erase(instr);
+  instr->Block->erase(instr->Index);
+  Version = F.CodeVersion;
+}
+
+const WhileDefUse &WhileFunction::defUse() const
+{
+  if (!DefUseChains || DefUseChains->Version != CodeVersion)
+    DefUseChains = std::make_shared<WhileDefUse>(*this);
+
+  return *DefUseChains;
+}
+
+WhileDefUse &WhileFunction::defUse()
+{
+  static_cast<const WhileFunction*>(this)->defUse();
+  return *DefUseChains;
+}
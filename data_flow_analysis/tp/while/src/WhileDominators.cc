@@ -0,0 +1,235 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements the computation of dominator trees, using the iterative
+// algorithm of Cooper, Harvey, and Kennedy over the reverse post-order, and of
+// dominance frontiers. The analyses are cached on the functions.
+
+#include "WhileDominators.h"
+
+#include <algorithm>
+#include <utility>
+
+WhileDominatorTree::WhileDominatorTree(const WhileFunction &f, bool post)
+  : Post(post), IDom(f.Body.size()), Children(f.Body.size()),
+    DFSIn(f.Body.size()), DFSOut(f.Body.size())
+{
+  // Nodes of the (reversed) graph are the blocks, along with a virtual root
+  // node preceding the roots of the tree.
+  unsigned int root = f.Body.size();
+  std::vector<std::vector<unsigned int> > succs(root + 1);
+  std::vector<std::vector<unsigned int> > preds(root + 1);
+  auto addEdge = [&](unsigned int from, unsigned int to) {
+    succs[from].emplace_back(to);
+    preds[to].emplace_back(from);
+  };
+
+  for(WhileBlock *bb : f.Body)
+  {
+    bool exit = true;
+    for(const WhileBlock *succ : bb->Succ)
+    {
+      if (!succ)
+        continue;
+
+      exit = false;
+      if (post)
+        addEdge(succ->Index, bb->Index);
+      else
+        addEdge(bb->Index, succ->Index);
+    }
+
+    if ((post && exit) || (!post && bb->isEntry()))
+      addEdge(root, bb->Index);
+  }
+
+  // Compute the post-order, the stack holds the next successor to visit.
+  std::vector<unsigned int> postorder;
+  std::vector<bool> visited(root + 1);
+  std::vector<std::pair<unsigned int, unsigned int> > stack;
+  stack.emplace_back(root, 0);
+  visited[root] = true;
+  while (!stack.empty())
+  {
+    auto &[n, succ] = stack.back();
+    if (succ < succs[n].size())
+    {
+      unsigned int next = succs[n][succ++];
+      if (!visited[next])
+      {
+        visited[next] = true;
+        stack.emplace_back(next, 0);
+      }
+    }
+    else
+    {
+      postorder.emplace_back(n);
+      stack.pop_back();
+    }
+  }
+
+  std::vector<unsigned int> order(root + 1);
+  for(unsigned int idx = 0; idx < postorder.size(); idx++)
+    order[postorder[idx]] = idx;
+
+  // Nodes without an immediate dominator yet refer to themselves.
+  std::vector<unsigned int> idom(root + 1);
+  for(unsigned int n = 0; n <= root; n++)
+    idom[n] = n;
+
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for(auto n = postorder.rbegin(); n != postorder.rend(); n++)
+    {
+      if (*n == root)
+        continue;
+
+      unsigned int newidom = *n;
+      for(unsigned int pred : preds[*n])
+      {
+        if (!visited[pred] || (idom[pred] == pred && pred != root))
+          continue;
+        else if (newidom == *n)
+        {
+          newidom = pred;
+          continue;
+        }
+
+        // The post-order number of dominators is larger.
+        unsigned int other = pred;
+        while (newidom != other)
+        {
+          while (order[newidom] < order[other])
+            newidom = idom[newidom];
+          while (order[other] < order[newidom])
+            other = idom[other];
+        }
+      }
+
+      if (idom[*n] != newidom)
+      {
+        idom[*n] = newidom;
+        changed = true;
+      }
+    }
+  }
+
+  for(auto n = postorder.rbegin(); n != postorder.rend(); n++)
+  {
+    if (*n == root)
+      continue;
+
+    WhileBlock *bb = f.Body[*n];
+    ReversePostOrder.emplace_back(bb);
+    if (idom[*n] == root)
+      Roots.emplace_back(bb);
+    else
+    {
+      IDom[*n] = f.Body[idom[*n]];
+      Children[idom[*n]].emplace_back(bb);
+    }
+  }
+
+  // Number the blocks in a depth-first traversal of the tree.
+  unsigned int number = 1;
+  for(WhileBlock *r : Roots)
+  {
+    std::vector<std::pair<WhileBlock*, unsigned int> > tree;
+    tree.emplace_back(r, 0);
+    DFSIn[r->Index] = number++;
+    while (!tree.empty())
+    {
+      auto &[bb, child] = tree.back();
+      if (child < Children[bb->Index].size())
+      {
+        WhileBlock *next = Children[bb->Index][child++];
+        DFSIn[next->Index] = number++;
+        tree.emplace_back(next, 0);
+      }
+      else
+      {
+        DFSOut[bb->Index] = number++;
+        tree.pop_back();
+      }
+    }
+  }
+}
+
+WhileDominanceFrontiers::WhileDominanceFrontiers(const WhileFunction &f,
+                                                 const WhileDominatorTree &DT)
+  : Frontier(f.Body.size())
+{
+  assert(!DT.Post && "Frontiers are computed from the dominator tree");
+
+  for(WhileBlock *bb : DT.ReversePostOrder)
+  {
+    if (bb->Pred.size() < 2)
+      continue;
+
+    for(const auto &[pred, kind] : bb->Pred)
+    {
+      WhileBlock *runner = pred;
+      while (runner && runner != DT.IDom[bb->Index] && DT.isReachable(runner))
+      {
+        auto &frontier = Frontier[runner->Index];
+        if (frontier.empty() || frontier.back() != bb)
+          frontier.emplace_back(bb);
+
+        runner = DT.IDom[runner->Index];
+      }
+    }
+  }
+}
+
+const WhileDominatorTree &WhileFunction::dominators() const
+{
+  if (!DomTree.Result || DomTree.Version != CFGVersion)
+  {
+    DomTree.Result = std::make_shared<WhileDominatorTree>(*this);
+    DomTree.Version = CFGVersion;
+  }
+
+  return *DomTree.Result;
+}
+
+const WhileDominatorTree &WhileFunction::postDominators() const
+{
+  if (!PostDomTree.Result || PostDomTree.Version != CFGVersion)
+  {
+    PostDomTree.Result = std::make_shared<WhileDominatorTree>(*this, true);
+    PostDomTree.Version = CFGVersion;
+  }
+
+  return *PostDomTree.Result;
+}
+
+const WhileDominanceFrontiers &WhileFunction::frontiers() const
+{
+  if (!Frontiers.Result || Frontiers.Version != CFGVersion)
+  {
+    Frontiers.Result = std::make_shared<WhileDominanceFrontiers>(*this,
+                                                                 dominators());
+    Frontiers.Version = CFGVersion;
+  }
+
+  return *Frontiers.Result;
+}
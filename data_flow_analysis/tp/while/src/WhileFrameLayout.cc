@@ -0,0 +1,374 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements the layout of stack frames. The frame objects of a
+// function are assigned new offsets, such that objects whose lifetimes do not
+// overlap share the same slots. Slots reserved for variables kept in registers
+// are dropped, which shrinks the frame size.
+
+#include "WhilePass.h"
+
+#include <algorithm>
+
+struct WhileFrameLayout : public WhileFunctionPass
+{
+  // Frame objects overlapping in the frame, e.g., after a previous layout, are
+  // relocated together.
+  struct Group
+  {
+    unsigned int Offset;
+    unsigned int Size;
+    int NewOffset = -1;
+
+    // Accessed with an unknown offset from the frame pointer, the group cannot
+    // be moved.
+    bool Pinned = false;
+
+    // The address of the group is stored, passed to a call, or returned.
+    bool Escapes = false;
+
+    // Blocks accessing the group, and those where its contents are live, i.e.,
+    // that are on a path between two accesses.
+    std::vector<bool> Accessed;
+    std::vector<bool> Live;
+
+    bool overlaps(unsigned int offset, unsigned int size) const
+    {
+      return offset < NewOffset + Size && NewOffset < (int)(offset + size);
+    }
+  };
+
+  std::vector<Group> Groups;
+
+  int groupOf(unsigned int slot) const
+  {
+    for(unsigned int g = 0; g < Groups.size(); g++)
+      if (Groups[g].Offset <= slot && slot < Groups[g].Offset + Groups[g].Size)
+        return g;
+
+    return -1;
+  }
+
+  void buildGroups(const WhileFunction &f)
+  {
+    std::vector<WhileFrameObject> objects = f.FrameObjects;
+    std::sort(objects.begin(), objects.end(),
+              [](const WhileFrameObject &a, const WhileFrameObject &b) {
+                return a.Offset < b.Offset;
+              });
+
+    Groups.clear();
+    for(const WhileFrameObject &obj : objects)
+    {
+      if (!Groups.empty() &&
+          obj.Offset < Groups.back().Offset + Groups.back().Size)
+      {
+        Group &g = Groups.back();
+        g.Size = std::max(g.Size, obj.Offset + obj.Size - g.Offset);
+      }
+      else
+      {
+        Groups.emplace_back();
+        Groups.back().Offset = obj.Offset;
+        Groups.back().Size = obj.Size;
+        Groups.back().Accessed.resize(f.Body.size());
+      }
+    }
+  }
+
+  // Record the accesses to the groups, returns false when a frame slot outside
+  // of all frame objects is accessed.
+  bool findAccesses(const WhileFunction &f)
+  {
+    // Groups whose address may be held by each register, computed
+    // flow-insensitively over arithmetic on addresses.
+    std::vector<std::vector<bool> > pointsTo(f.NumRegisters,
+                                             std::vector<bool>(Groups.size()));
+    std::vector<bool> indirect(f.Body.size());
+    for(const WhileBlock *bb : f.Body)
+    {
+      for(const WhileInstr *instr : bb->Body)
+      {
+        if (instr->Opc == WCALL ||
+            (instr->Opc == WLOAD && !instr->Ops[1].isImm()) ||
+            (instr->Opc == WSTORE && !instr->Ops[0].isImm()))
+          indirect[bb->Index] = true;
+
+        for(unsigned int idx = 0; idx < instr->Ops.size(); idx++)
+        {
+          if (instr->Ops[idx].Kind != WFRAMEPOINTER)
+            continue;
+
+          int offs = instr->frameOffset(idx);
+          int g = groupOf(offs >= 0 ? instr->Ops[offs].ValueOrIndex : 0);
+          if (g < 0 || (offs < 0 && Groups[g].Offset != 0))
+            return false;
+
+          Groups[g].Accessed[bb->Index] = true;
+
+          // The frame pointer is used with an unknown offset.
+          if (offs < 0)
+            Groups[g].Pinned = true;
+
+          // Addresses other than those of loads and stores escape, e.g.,
+          // when stored to memory or passed to a call.
+          bool address = (instr->Opc == WLOAD && idx == 1) ||
+                         (instr->Opc == WSTORE && idx == 0);
+          if (offs >= 0 && instr->Opc == WPLUS)
+            pointsTo[instr->Ops[0].ValueOrIndex][g] = true;
+          else if (!address)
+            Groups[g].Escapes = true;
+        }
+      }
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+      changed = false;
+      for(const WhileBlock *bb : f.Body)
+      {
+        for(const WhileInstr *instr : bb->Body)
+        {
+          if (!instr->isPure())
+            continue;
+
+          std::vector<bool> &def = pointsTo[instr->Ops[0].ValueOrIndex];
+          for(unsigned int idx = 1; idx < instr->Ops.size(); idx++)
+          {
+            const WhileOperand &op = instr->Ops[idx];
+            if (op.Kind != WREGISTER)
+              continue;
+
+            for(unsigned int g = 0; g < Groups.size(); g++)
+            {
+              if (pointsTo[op.ValueOrIndex][g] && !def[g])
+              {
+                def[g] = true;
+                changed = true;
+              }
+            }
+          }
+        }
+      }
+    }
+
+    // Addresses used by loads and stores access the group, addresses stored to
+    // memory, passed to calls, or returned escape.
+    for(const WhileBlock *bb : f.Body)
+    {
+      for(const WhileInstr *instr : bb->Body)
+      {
+        if (instr->isPure())
+          continue;
+
+        for(unsigned int idx = 0; idx < instr->Ops.size(); idx++)
+        {
+          const WhileOperand &op = instr->Ops[idx];
+          if (op.Kind != WREGISTER || !instr->isUse(idx))
+            continue;
+
+          bool access = (instr->Opc == WLOAD && idx >= 1) ||
+                        (instr->Opc == WSTORE && idx <= 1);
+          for(unsigned int g = 0; g < Groups.size(); g++)
+          {
+            if (!pointsTo[op.ValueOrIndex][g])
+              continue;
+            else if (access)
+              Groups[g].Accessed[bb->Index] = true;
+            else if (instr->Opc != WBRANCHZ)
+              Groups[g].Escapes = true;
+          }
+        }
+      }
+    }
+
+    // Parameters in memory are stored by the caller at fixed offsets.
+    for(unsigned int idx = 0; idx < f.ParameterRegisters.size(); idx++)
+    {
+      int g = f.ParameterRegisters[idx] < 0 ? groupOf(idx) : -1;
+      if (g < 0)
+        continue;
+
+      Groups[g].Accessed[0] = true;
+      Groups[g].Pinned = true;
+    }
+
+    // Escaping groups may be accessed by any indirect access, or by calls.
+    for(Group &g : Groups)
+      if (g.Escapes)
+        for(unsigned int bb = 0; bb < f.Body.size(); bb++)
+          g.Accessed[bb] = g.Accessed[bb] || indirect[bb];
+
+    return true;
+  }
+
+  static void computeLiveness(const WhileFunction &f, Group &g)
+  {
+    unsigned int n = f.Body.size();
+    std::vector<bool> reached(n);
+    std::vector<bool> needed(n);
+
+    // Blocks entered after an access, and those left before an access.
+    bool changed = true;
+    while (changed)
+    {
+      changed = false;
+      for(const WhileBlock *bb : f.Body)
+      {
+        bool in = false;
+        for(const auto &[pred, kind] : bb->Pred)
+          in = in || reached[pred->Index] || g.Accessed[pred->Index];
+
+        bool out = false;
+        for(const WhileBlock *succ : bb->Succ)
+          out = out || (succ && (needed[succ->Index] ||
+                                 g.Accessed[succ->Index]));
+
+        if (in != reached[bb->Index] || out != needed[bb->Index])
+        {
+          reached[bb->Index] = in;
+          needed[bb->Index] = out;
+          changed = true;
+        }
+      }
+    }
+
+    g.Live.resize(n);
+    for(unsigned int bb = 0; bb < n; bb++)
+      g.Live[bb] = g.Accessed[bb] || (reached[bb] && needed[bb]);
+  }
+
+  static bool interfere(const Group &a, const Group &b)
+  {
+    for(unsigned int bb = 0; bb < a.Live.size(); bb++)
+      if (a.Live[bb] && b.Live[bb])
+        return true;
+
+    return false;
+  }
+
+  // Place a group at the lowest offset not overlapping with the groups placed
+  // so far that it interferes with.
+  void place(unsigned int g)
+  {
+    std::vector<unsigned int> candidates = {0};
+    for(const Group &other : Groups)
+      if (other.NewOffset >= 0)
+        candidates.emplace_back(other.NewOffset + other.Size);
+
+    std::sort(candidates.begin(), candidates.end());
+    for(unsigned int offset : candidates)
+    {
+      bool fits = true;
+      for(const Group &other : Groups)
+        if (other.NewOffset >= 0 && &other != &Groups[g] &&
+            other.overlaps(offset, Groups[g].Size) &&
+            interfere(other, Groups[g]))
+          fits = false;
+
+      if (fits)
+      {
+        Groups[g].NewOffset = offset;
+        return;
+      }
+    }
+    abort();
+  }
+
+  bool run(WhileFunction &f) override
+  {
+    buildGroups(f);
+    if (!findAccesses(f))
+      return false;
+
+    for(Group &g : Groups)
+      computeLiveness(f, g);
+
+    // Pinned groups stay in place, larger groups are placed first.
+    std::vector<unsigned int> order;
+    for(unsigned int g = 0; g < Groups.size(); g++)
+    {
+      if (Groups[g].Pinned)
+        Groups[g].NewOffset = Groups[g].Offset;
+      else
+        order.emplace_back(g);
+    }
+
+    std::stable_sort(order.begin(), order.end(),
+                     [this](unsigned int a, unsigned int b) {
+                       return Groups[a].Size > Groups[b].Size;
+                     });
+
+    for(unsigned int g : order)
+      place(g);
+
+    unsigned int framesize = 0;
+    bool moved = false;
+    for(const Group &g : Groups)
+    {
+      framesize = std::max(framesize, g.NewOffset + g.Size);
+      moved |= g.NewOffset != (int)g.Offset;
+    }
+
+    if (!moved && framesize == f.FrameSize)
+      return false;
+
+    for(WhileBlock *bb : f.Body)
+    {
+      for(WhileInstr *instr : bb->Body)
+      {
+        // Addresses computed from moved slots may leave the frame.
+        instr->InBounds = false;
+        for(unsigned int idx = 0; idx < instr->Ops.size(); idx++)
+        {
+          int offs = instr->frameOffset(idx);
+          if (instr->Ops[idx].Kind != WFRAMEPOINTER || offs < 0)
+            continue;
+
+          WhileOperand &slot = instr->Ops[offs];
+          const Group &g = Groups[groupOf(slot.ValueOrIndex)];
+          slot.ValueOrIndex += g.NewOffset - g.Offset;
+        }
+      }
+    }
+
+    for(WhileFrameObject &obj : f.FrameObjects)
+    {
+      const Group &g = Groups[groupOf(obj.Offset)];
+      obj.Offset += g.NewOffset - g.Offset;
+
+      // Symbols of inlined functions keep their offset in the callee.
+      auto local = f.Locals.find(*obj.Symbol->Name);
+      if (local != f.Locals.end() && local->second == obj.Symbol)
+        obj.Symbol->Offset = obj.Offset;
+    }
+
+    f.FrameSize = framesize;
+    return true;
+  }
+
+  WhileFrameLayout() : WhileFunctionPass("framelayout",
+                                         "Frame slot sharing and compaction")
+  {
+  }
+};
+
+WhileFrameLayout WFL;
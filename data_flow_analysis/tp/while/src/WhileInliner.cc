@@ -0,0 +1,331 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements function inlining. Calls are replaced by a copy of the
+// callee's blocks, whose registers are renamed to fresh registers of the caller
+// and whose frame is placed at the end of the caller's frame. Returns branch to
+// a continuation block holding the instructions following the call. Small
+// callees are always inlined, larger ones only from frequently executed blocks,
+// using the execution counts of a profile when available.
+
+#include "WhilePass.h"
+#include "WhileLiveness.h"
+#include "WhileLoops.h"
+
+#include <algorithm>
+#include <cmath>
+
+struct WhileInliner : public WhileFunctionPass
+{
+  // Callees up to InlineSize instructions are inlined, up to HotInlineSize for
+  // calls executed at least HotFrequency times per execution of the caller.
+  static const unsigned int InlineSize = 12;
+  static const unsigned int HotInlineSize = 40;
+  static constexpr double HotFrequency = 10;
+
+  // Limits on the size of callers, and on the nesting of inlined calls.
+  static const unsigned int MaxCallerSize = 400;
+  static const unsigned int MaxDepth = 3;
+
+  // Estimated number of executions of a block per execution of its function,
+  // from the profile or assuming ten iterations per loop.
+  static double frequency(const WhileBlock *bb)
+  {
+    const WhileFunction &f = *bb->Function;
+    if (f.Program->HasProfile)
+    {
+      unsigned long entry = f.Body.front()->Count;
+      return entry ? (double)bb->Count / entry : 0;
+    }
+
+    return std::pow(10, f.loops().depth(bb));
+  }
+
+  static bool shouldInline(const WhileInstr &call, const WhileFunction &callee)
+  {
+    const WhileFunction &f = *call.Block->Function;
+    unsigned int calleesize = callee.size();
+    if (&callee == &f || f.size() + calleesize > MaxCallerSize)
+      return false;
+
+    // Calls that are never executed are only inlined when this does not
+    // increase the code size, i.e., for callees not larger than the call, its
+    // return, and the moves of the arguments.
+    double freq = frequency(call.Block);
+    if (freq == 0)
+      return calleesize <= call.Ops.size();
+    else if (freq >= HotFrequency)
+      return calleesize <= HotInlineSize;
+
+    return calleesize <= InlineSize;
+  }
+
+  struct Inlining
+  {
+    WhileFunction &F;
+    const WhileFunction &Callee;
+    WhileInstr *Call;
+
+    unsigned int RegisterBase;
+    unsigned int FrameBase;
+
+    // Register holding the address of the callee's frame, if needed.
+    int FrameRegister = -1;
+
+    std::vector<WhileBlock*> Clones;
+    WhileBlock *Continuation = nullptr;
+    std::vector<WhileInstr*> Calls;
+
+    Inlining(WhileInstr *call, const WhileFunction &callee)
+      : F(*call->Block->Function), Callee(callee), Call(call),
+        RegisterBase(F.NumRegisters), FrameBase(F.FrameSize)
+    {
+      bool framereg = false;
+      for(const WhileBlock *bb : Callee.Body)
+        for(const WhileInstr *instr : bb->Body)
+          for(unsigned int idx = 0; idx < instr->Ops.size(); idx++)
+            if (instr->Ops[idx].Kind == WFRAMEPOINTER &&
+                instr->frameOffset(idx) < 0)
+              framereg = true;
+
+      F.NumRegisters += Callee.NumRegisters;
+      F.FrameSize += Callee.FrameSize;
+      for(WhileFrameObject obj : Callee.FrameObjects)
+      {
+        obj.Offset += FrameBase;
+        F.FrameObjects.emplace_back(obj);
+      }
+
+      if (framereg)
+        FrameRegister = F.NumRegisters++;
+    }
+
+    WhileInstr *create(WhileBlock *bb, WhileOpcode opc, unsigned int numops)
+    {
+      return bb->createInstr(Call->Line, Call->OffsetOnLine, opc, numops);
+    }
+
+    // Emit OpD = 0 + Val before position idx of bb.
+    void move(WhileBlock *bb, unsigned int idx, const WhileOperand &dst,
+              const WhileOperand &val)
+    {
+      bb->insert(idx, bb->createMove(*Call, dst, val));
+    }
+
+    // Frame slots accessed with a constant offset are relocated by adjusting the
+    // offset, other uses of the frame pointer use the frame register instead.
+    WhileOperand remap(const WhileInstr &instr, unsigned int idx) const
+    {
+      WhileOperand op = instr.Ops[idx];
+      switch (op.Kind)
+      {
+        case WREGISTER:
+          op.ValueOrIndex += RegisterBase;
+          break;
+        case WFRAMEPOINTER:
+          if (instr.frameOffset(idx) < 0)
+            op = WhileOperand(WREGISTER, FrameRegister);
+          break;
+        case WIMMEDIATE:
+          for(unsigned int fp = 0; fp < instr.Ops.size(); fp++)
+            if (instr.Ops[fp].Kind == WFRAMEPOINTER &&
+                instr.frameOffset(fp) == (int)idx)
+              op.ValueOrIndex += FrameBase;
+          break;
+        case WBLOCK:
+          op.ValueOrIndex = Clones[op.ValueOrIndex]->Index;
+          break;
+        case WFUNCTION:
+        case WUNKNOWN:
+          break;
+      }
+
+      return op;
+    }
+
+    void clone(const WhileBlock *bb, WhileBlock *clone)
+    {
+      for(const WhileInstr *instr : bb->Body)
+      {
+        if (instr->Opc == WRETURN)
+        {
+          move(clone, clone->Body.size(), Call->Ops[1], remap(*instr, 0));
+
+          WhileInstr *branch = create(clone, WBRANCH, 1);
+          branch->Ops[0] = WhileOperand(WBLOCK, Continuation->Index);
+          clone->insert(clone->Body.size(), branch);
+          clone->addEdge(WBRANCH_TAKEN, Continuation);
+          continue;
+        }
+
+        WhileInstr *c = clone->createInstr(instr->Line, instr->OffsetOnLine,
+                                           instr->Opc, instr->Ops.size());
+        for(unsigned int idx = 0; idx < instr->Ops.size(); idx++)
+          c->Ops[idx] = remap(*instr, idx);
+
+        clone->insert(clone->Body.size(), c);
+        if (c->Opc == WCALL)
+          Calls.emplace_back(c);
+      }
+
+      for(unsigned int kind = WFALL_THROUGH; kind <= WBRANCH_TAKEN; kind++)
+        if (bb->Succ[kind])
+          clone->addEdge((WhileSuccKind)kind, Clones[bb->Succ[kind]->Index]);
+    }
+
+    void run()
+    {
+      WhileBlock *bb = Call->Block;
+      unsigned int first = F.Body.size();
+      for(const WhileBlock *cbb : Callee.Body)
+      {
+        Clones.emplace_back(F.createBlock());
+        unsigned long entry = Callee.Body.front()->Count;
+        if (entry)
+        {
+          Clones.back()->Count = cbb->Count * bb->Count / entry;
+          Clones.back()->TakenCount = cbb->TakenCount * bb->Count / entry;
+        }
+      }
+
+      // The instructions following the call and the successors of its block
+      // move to the continuation.
+      Continuation = F.createBlock();
+      Continuation->Count = bb->Count;
+      Continuation->TakenCount = bb->TakenCount;
+      bb->TakenCount = 0;
+      while (bb->Body.size() > Call->Index + 1)
+      {
+        WhileInstr *instr = bb->Body[Call->Index + 1];
+        bb->erase(instr->Index);
+        Continuation->insert(Continuation->Body.size(), instr);
+      }
+
+      for(unsigned int kind = WFALL_THROUGH; kind <= WBRANCH_TAKEN; kind++)
+      {
+        WhileBlock *succ = bb->Succ[kind];
+        if (succ)
+        {
+          bb->removeEdge((WhileSuccKind)kind);
+          Continuation->addEdge((WhileSuccKind)kind, succ);
+        }
+      }
+
+      for(const WhileBlock *cbb : Callee.Body)
+        clone(cbb, Clones[cbb->Index]);
+
+      // Pass the arguments and clear the registers read before being written,
+      // as registers are zero on entry of a function.
+      unsigned int idx = Call->Index;
+      bb->erase(idx);
+
+      // The address of the frame escapes, the callee of a tail call could
+      // access it.
+      if (FrameRegister >= 0)
+      {
+        for(WhileBlock *fbb : F.Body)
+          for(WhileInstr *instr : fbb->Body)
+            instr->TailCall = false;
+
+        WhileInstr *fp = create(bb, WPLUS, 3);
+        fp->Ops[0] = WhileOperand(WREGISTER, FrameRegister);
+        fp->Ops[1] = WhileOperand(WFRAMEPOINTER);
+        fp->Ops[2] = WhileOperand(WIMMEDIATE, FrameBase);
+        bb->insert(idx++, fp);
+      }
+
+      WhileRegisterSet clear = WhileLiveness(Callee).LiveIn[0];
+      for(unsigned int arg = 0; arg < Callee.ParameterRegisters.size(); arg++)
+      {
+        int reg = Callee.ParameterRegisters[arg];
+        const WhileOperand &val = Call->Ops[arg + 2];
+        if (reg >= 0)
+        {
+          move(bb, idx++, WhileOperand(WREGISTER, RegisterBase + reg), val);
+          clear[reg] = false;
+          continue;
+        }
+
+        WhileInstr *store = create(bb, WSTORE, 3);
+        store->Ops[0] = WhileOperand(WFRAMEPOINTER);
+        store->Ops[1] = WhileOperand(WIMMEDIATE, FrameBase + arg);
+        store->Ops[2] = val;
+        bb->insert(idx++, store);
+      }
+
+      for(unsigned int r = 0; r < Callee.NumRegisters; r++)
+        if (clear[r])
+          move(bb, idx++, WhileOperand(WREGISTER, RegisterBase + r),
+               WhileOperand(WIMMEDIATE, 0));
+
+      bb->addEdge(WFALL_THROUGH, Clones.front());
+
+      // Place the inlined blocks after the call.
+      std::rotate(F.Body.begin() + bb->Index + 1, F.Body.begin() + first,
+                  F.Body.end());
+      F.renumber();
+    }
+  };
+
+  bool run(WhileFunction &f) override
+  {
+    // Functions are visited in the order of their definition, callees have
+    // thus been processed before their callers, except for recursive calls.
+    // Calls of inlined code are considered in turn, up to MaxDepth.
+    std::vector<std::pair<WhileInstr*, unsigned int> > worklist;
+    for(WhileBlock *bb : f.Body)
+      for(WhileInstr *instr : bb->Body)
+        if (instr->Opc == WCALL)
+          worklist.emplace_back(instr, 0);
+
+    std::reverse(worklist.begin(), worklist.end());
+
+    bool changed = false;
+    while (!worklist.empty())
+    {
+      auto [call, depth] = worklist.back();
+      worklist.pop_back();
+
+      int callee = call->Ops[0].ValueOrIndex;
+      if (callee < 0 || depth >= MaxDepth)
+        continue;
+
+      // The blocks of callees in SSA form cannot be copied without their phis.
+      const WhileFunction &g = *f.Program->FunctionsByIndex[callee];
+      if (!accepts(g) || !shouldInline(*call, g))
+        continue;
+
+      Inlining I(call, g);
+      I.run();
+      for(auto c = I.Calls.rbegin(); c != I.Calls.rend(); c++)
+        worklist.emplace_back(*c, depth + 1);
+
+      changed = true;
+    }
+
+    return changed;
+  }
+
+  WhileInliner() : WhileFunctionPass("inline", "Function inlining")
+  {
+  }
+};
+
+WhileInliner WINL;
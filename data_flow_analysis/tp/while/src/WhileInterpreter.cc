@@ -25,6 +25,7 @@
 
 #include "WhileInterpreter.h"
 
+#include <algorithm>
 #include <cassert>
 
 int WhilePrintInt(WhileState &s, std::vector<int> &ops)
@@ -73,9 +74,10 @@ WhileState::WhileState(const WhileProgram *program, unsigned int stacksize)
   const auto main = Program->Functions.find("main");
   if (main != Program->Functions.end())
   {
-    const WhileBlock &entryBB = main->second.Body.front();
+    const WhileBlock *entryBB = main->second.Body.front();
 
-    Context.emplace_back(&main->second, &entryBB, entryBB.Body.begin(), program->DataSize);
+    Context.emplace_back(&main->second, entryBB, entryBB->Body.begin(), program->DataSize);
+    reserveFrame(Context.back());
 
     for(auto [n, g] : Program->Globals)
     {
@@ -88,6 +90,56 @@ WhileState::WhileState(const WhileProgram *program, unsigned int stacksize)
   }
 }
 
+int &WhileState::memory(int address)
+{
+  unsigned int addr = address;
+  if (address >= 0 && addr >= Memory.size() &&
+      addr < Program->DataSize + MaxStackSize)
+  {
+    unsigned int size = std::max<unsigned int>(2 * Memory.size(), addr + 1);
+    Memory.resize(std::min(size, Program->DataSize + MaxStackSize));
+  }
+
+  return Memory.at(addr);
+}
+
+void WhileState::reserveFrame(const WhileContext &ctx)
+{
+  if (ctx.Function->FrameSize)
+    memory(ctx.FramePointer + ctx.Function->FrameSize - 1);
+}
+
+void WhileState::enableProfile()
+{
+  BlockCounts.resize(Program->FunctionsByIndex.size());
+  TakenCounts.resize(Program->FunctionsByIndex.size());
+  for(const WhileFunction *f : Program->FunctionsByIndex)
+  {
+    BlockCounts[f->Index].resize(f->Body.size());
+    TakenCounts[f->Index].resize(f->Body.size());
+  }
+
+  // Count the entry block of main, when execution did not start yet.
+  for(const WhileContext &ctx : Context)
+    if (ctx.InstructionPointer == ctx.Block->Body.begin())
+      BlockCounts[ctx.Function->Index][ctx.Block->Index]++;
+}
+
+void WhileState::enterBlock(WhileContext &ctx, const WhileBlock *bb)
+{
+  ctx.Block = bb;
+  ctx.InstructionPointer = bb->Body.begin();
+  if (!BlockCounts.empty())
+    BlockCounts[ctx.Function->Index][bb->Index]++;
+}
+
+void WhileState::takeBranch(WhileContext &ctx, const WhileBlock *bb)
+{
+  if (!TakenCounts.empty())
+    TakenCounts[ctx.Function->Index][ctx.Block->Index]++;
+  enterBlock(ctx, bb);
+}
+
 int WhileState::readDataOperand(const WhileInstr &i, unsigned int idx) const
 {
   const WhileOperand &op = i.Ops[idx];
@@ -137,12 +189,7 @@ const WhileBlock *WhileState::readBBOperand(const WhileInstr &i,
   {
     case WBLOCK:
       if (op.ValueOrIndex < 0) return nullptr;
-      else
-      {
-        auto it = ctx.Function->Body.cbegin();
-        std::advance(it, op.ValueOrIndex);
-        return &*it;
-      }
+      else return ctx.Function->Body[op.ValueOrIndex];
 
     case WFUNCTION:
     case WFRAMEPOINTER:
@@ -188,22 +235,22 @@ void WhileState::step(bool trace)
 
   WhileContext &ctx = Context.back();
 
-  const WhileBlock *block = ctx.Block;
-  const auto &body = block->Body;
-  if (ctx.InstructionPointer == body.cend())
+  // skip to the next non-empty block
+  while (ctx.InstructionPointer == ctx.Block->Body.end())
   {
-    ctx.Block = block->Succ.at(WFALL_THROUGH);
-    ctx.InstructionPointer = ctx.Block->Body.cbegin();
+    const WhileBlock *nextBB = ctx.Block->Succ[WFALL_THROUGH];
+    assert(nextBB && "Falling off the end of a function");
+    enterBlock(ctx, nextBB);
   }
 
-  const WhileInstr &instr = *ctx.InstructionPointer;
+  const WhileInstr &instr = **ctx.InstructionPointer;
   const auto &ops = instr.Ops;
 
   if (trace)
   {
     std::cout << ctx.Function->Name << "(" << ctx.Function->Index << ")::"
               << ctx.Block->Index << "::"
-              << ctx.InstructionPointer->Index
+              << instr.Index
               << ": ";
     instr.dump(std::cout);
 
@@ -224,13 +271,35 @@ void WhileState::step(bool trace)
 
       if (fun)
       {
-        const WhileBlock &entryBB = fun->Body.front();
+        const WhileBlock *entryBB = fun->Body.front();
         unsigned int nextFP = ctx.FramePointer + ctx.Function->FrameSize;
 
+        std::vector<int> args;
         for(unsigned int i = 2; i < ops.size(); i++)
-          Memory.at(nextFP + i - 2) = readDataOperand(instr, i);
+          args.emplace_back(readDataOperand(instr, i));
+
+        // Tail calls replace the caller, the callee returns to the caller's
+        // caller and reuses the frame.
+        if (instr.TailCall)
+        {
+          nextFP = ctx.FramePointer;
+          Context.pop_back();
+        }
 
-        Context.emplace_back(fun, &entryBB, entryBB.Body.begin(), nextFP);
+        Context.emplace_back(fun, entryBB, entryBB->Body.begin(), nextFP);
+        enterBlock(Context.back(), entryBB);
+        reserveFrame(Context.back());
+
+        // Arguments are passed in the callee's registers, or in its frame.
+        assert(args.size() == fun->ParameterRegisters.size());
+        for(unsigned int i = 0; i < args.size(); i++)
+        {
+          int reg = fun->ParameterRegisters[i];
+          if (reg >= 0)
+            Context.back().Registers[reg] = args[i];
+          else
+            memory(nextFP + i) = args[i];
+        }
       }
       else
       {
@@ -264,7 +333,8 @@ void WhileState::step(bool trace)
       int base = readDataOperand(instr, 1);
       int offset = readDataOperand(instr, 2);
 
-      int result = Memory.at(base + offset);
+      int result = instr.InBounds ? Memory[base + offset]
+                                   : memory(base + offset);
       if (trace)
         std::cout << " writes " << result;
 
@@ -282,7 +352,10 @@ void WhileState::step(bool trace)
       if (trace)
         std::cout << " writes " << value;
 
-      Memory.at(base + offset) = value;
+      if (instr.InBounds)
+        Memory[base + offset] = value;
+      else
+        memory(base + offset) = value;
       break;
     }
     case WPLUS:
@@ -407,8 +480,7 @@ void WhileState::step(bool trace)
           if (trace)
             std::cout << " taken";
 
-          ctx.Block = nextBB;
-          ctx.InstructionPointer = nextBB->Body.cbegin();
+          takeBranch(ctx, nextBB);
         }
       }
       else
@@ -423,8 +495,7 @@ void WhileState::step(bool trace)
       const WhileBlock *nextBB = readBBOperand(instr, 0);
       if (nextBB)
       {
-        ctx.Block = nextBB;
-        ctx.InstructionPointer = nextBB->Body.cbegin();
+        takeBranch(ctx, nextBB);
       }
       else
       {
@@ -481,6 +552,9 @@ void WhileState::step(bool trace)
       }
       break;
     }
+    case WPHI:
+      assert("Phis are not executed, programs have to leave SSA form.");
+      abort();
   }
 
   if (trace)
@@ -507,7 +581,7 @@ std::ostream &WhileState::dump(std::ostream &s) const
       << ctx.Block->Index << "::" ;
 
     if (IP != ctx.Block->Body.end())
-      s << IP->Index << "\t # " << IP->Line << ":" << IP->OffsetOnLine << "\n";
+      s << (*IP)->Index << "\t # " << (*IP)->Line << ":" << (*IP)->OffsetOnLine << "\n";
     else
       s << "??\n";
   }
@@ -522,3 +596,14 @@ std::ostream &WhileState::dump(std::ostream &s) const
 
   return s;
 }
+
+std::ostream &WhileState::dumpProfile(std::ostream &s) const
+{
+  for(const WhileFunction *f : Program->FunctionsByIndex)
+    for(const WhileBlock *bb : f->Body)
+      s << f->Name << " " << bb->Index << " "
+        << BlockCounts.at(f->Index).at(bb->Index) << " "
+        << TakenCounts.at(f->Index).at(bb->Index) << "\n";
+
+  return s;
+}
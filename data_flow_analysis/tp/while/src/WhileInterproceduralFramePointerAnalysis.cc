@@ -144,6 +144,7 @@ struct WhileFramePointer
       case WUNEQUAL:
       case WLESS:
       case WLESSEQUAL:
+      case WPHI:
         // do not change the frame pointer
         return input;
     };
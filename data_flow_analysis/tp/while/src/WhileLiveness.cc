@@ -0,0 +1,78 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements the liveness analysis of symbolic registers, iterating
+// over the blocks in reverse order until a fixed point is reached.
+
+#include "WhileLiveness.h"
+
+WhileLiveness::WhileLiveness(const WhileFunction &f)
+  : LiveIn(f.Body.size(), WhileRegisterSet(f.NumRegisters)),
+    LiveOut(f.Body.size(), WhileRegisterSet(f.NumRegisters))
+{
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for(auto b = f.Body.rbegin(), e = f.Body.rend(); b != e; b++)
+    {
+      const WhileBlock *bb = *b;
+
+      WhileRegisterSet live(f.NumRegisters);
+      for(unsigned int kind = WFALL_THROUGH; kind <= WBRANCH_TAKEN; kind++)
+      {
+        const WhileBlock *succ = bb->Succ[kind];
+        if (!succ)
+          continue;
+
+        const WhileRegisterSet &in = LiveIn[succ->Index];
+        for(unsigned int r = 0; r < f.NumRegisters; r++)
+          if (in[r])
+            live[r] = true;
+
+        for(unsigned int p = 0; p < succ->Pred.size(); p++)
+        {
+          if (succ->Pred[p].Block != bb || succ->Pred[p].Kind != kind)
+            continue;
+
+          for(const WhileInstr *phi : succ->Phis)
+          {
+            const WhileOperand &op = phi->Ops[p + 1];
+            if (op.Kind == WREGISTER)
+              live[op.ValueOrIndex] = true;
+          }
+        }
+      }
+      LiveOut[bb->Index] = live;
+
+      for(auto i = bb->Body.end(); i != bb->Body.begin(); )
+        transfer(**--i, live);
+
+      for(const WhileInstr *phi : bb->Phis)
+        live[phi->Ops[0].ValueOrIndex] = false;
+
+      if (live != LiveIn[bb->Index])
+      {
+        LiveIn[bb->Index] = std::move(live);
+        changed = true;
+      }
+    }
+  }
+}
@@ -0,0 +1,221 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements loop-invariant code motion. Each loop is given a
+// preheader, then pure instructions and loads whose operands are not modified
+// by the loop are moved to the preheader, starting with the innermost loops.
+
+#include "WhilePass.h"
+#include "WhileLiveness.h"
+#include "WhileLoops.h"
+
+struct WhileLoopInvariantCodeMotion : public WhileFunctionPass
+{
+  struct LoopInfo
+  {
+    const WhileProgram &P;
+    const WhileFunction &F;
+    const WhileLoop &Loop;
+    const WhileDominatorTree &DT;
+    const WhileLiveness &WL;
+
+    // Number of definitions of each register inside of the loop.
+    std::vector<unsigned int> NumDefs;
+    std::vector<const WhileInstr*> Stores;
+    bool HasCalls = false;
+
+    LoopInfo(const WhileFunction &f, const WhileLoop &loop,
+             const WhileLiveness &wl)
+      : P(*f.Program), F(f), Loop(loop), DT(f.dominators()), WL(wl),
+        NumDefs(f.NumRegisters)
+    {
+      for(const WhileBlock *bb : Loop.Blocks)
+      {
+        for(const WhileInstr *instr : bb->Body)
+        {
+          const WhileOperand *def = instr->def();
+          if (def)
+            NumDefs[def->ValueOrIndex]++;
+
+          if (instr->Opc == WSTORE)
+            Stores.emplace_back(instr);
+          else if (instr->Opc == WCALL)
+            HasCalls = true;
+        }
+      }
+    }
+
+    bool isGlobal(const WhileOperand &base, const WhileOperand &offs) const
+    {
+      int addr = base.ValueOrIndex + offs.ValueOrIndex;
+      return base.isImm() && offs.isImm() && addr >= 0 &&
+             addr < (int)P.DataSize;
+    }
+
+    bool isFrame(const WhileOperand &base, const WhileOperand &offs) const
+    {
+      return base.Kind == WFRAMEPOINTER && offs.isImm() &&
+             offs.ValueOrIndex >= 0 && offs.ValueOrIndex < (int)F.FrameSize;
+    }
+
+    // Check whether the store may modify the value read by the load, whose
+    // operands are invariant.
+    bool mayAlias(const WhileInstr &store, const WhileInstr &load) const
+    {
+      const WhileOperand &base = store.Ops[0];
+      const WhileOperand &offs = store.Ops[1];
+      const WhileOperand &lbase = load.Ops[1];
+      const WhileOperand &loffs = load.Ops[2];
+      if (!offs.isImm() || !loffs.isImm())
+        return true;
+      else if (base.Kind == lbase.Kind &&
+               base.ValueOrIndex == lbase.ValueOrIndex)
+        return offs.ValueOrIndex == loffs.ValueOrIndex;
+      else if (base.isImm() && lbase.isImm())
+        return base.ValueOrIndex + offs.ValueOrIndex ==
+               lbase.ValueOrIndex + loffs.ValueOrIndex;
+
+      // Globals are located below all frames.
+      return !(isGlobal(base, offs) && lbase.Kind == WFRAMEPOINTER) &&
+             !(base.Kind == WFRAMEPOINTER && isGlobal(lbase, loffs));
+    }
+
+    // Check whether the block is executed in each iteration of the loop.
+    bool isExecuted(const WhileBlock *bb) const
+    {
+      for(const WhileBlock *latch : Loop.Latches)
+        if (!DT.dominates(bb, latch))
+          return false;
+
+      for(const auto &[from, to] : Loop.Exits)
+        if (!DT.dominates(bb, from))
+          return false;
+
+      return true;
+    }
+
+    bool canHoist(const WhileInstr &instr) const
+    {
+      bool isLoad = instr.Opc == WLOAD;
+      if (!instr.isPure() && !isLoad)
+        return false;
+
+      // Division by zero traps and must not be executed speculatively.
+      if (instr.Opc == WDIV &&
+          (!instr.Ops[2].isImm() || instr.Ops[2].isZero() ||
+           instr.Ops[2].ValueOrIndex == -1))
+        return false;
+
+      for(unsigned int idx = 1; idx < instr.Ops.size(); idx++)
+      {
+        const WhileOperand &op = instr.Ops[idx];
+        if (op.Kind == WREGISTER && NumDefs[op.ValueOrIndex])
+          return false;
+      }
+
+      // The register must not be read before its definition in the loop, nor
+      // after leaving the loop without passing the definition.
+      int r = instr.Ops[0].ValueOrIndex;
+      if (NumDefs[r] != 1 || WL.LiveIn[Loop.Header->Index][r])
+        return false;
+
+      for(const auto &[from, to] : Loop.Exits)
+        if (WL.LiveIn[to->Index][r] && !DT.dominates(instr.Block, from))
+          return false;
+
+      if (isLoad)
+      {
+        if (HasCalls)
+          return false;
+
+        for(const WhileInstr *store : Stores)
+          if (mayAlias(*store, instr))
+            return false;
+
+        // Memory accesses may fail, only frame and global accesses can be
+        // executed speculatively.
+        if (!isGlobal(instr.Ops[1], instr.Ops[2]) &&
+            !isFrame(instr.Ops[1], instr.Ops[2]) && !isExecuted(instr.Block))
+          return false;
+      }
+
+      return true;
+    }
+  };
+
+  static bool hoist(WhileFunction &f, const WhileLoop &loop,
+                    const WhileLiveness &WL)
+  {
+    LoopInfo LI(f, loop, WL);
+    WhileBlock *pre = preheader(loop);
+    unsigned int pos = pre->Body.size();
+    if (pos && pre->Body.back()->isTerminator())
+      pos--;
+
+    bool changed = false;
+    bool hoisted = true;
+    while (hoisted)
+    {
+      hoisted = false;
+      for(WhileBlock *bb : loop.Blocks)
+      {
+        for(unsigned int idx = 0; idx < bb->Body.size(); )
+        {
+          WhileInstr *instr = bb->Body[idx];
+          if (LI.canHoist(*instr))
+          {
+            LI.NumDefs[instr->Ops[0].ValueOrIndex]--;
+            bb->erase(idx);
+            pre->insert(pos++, instr);
+            instr->InBounds = false;
+            hoisted = true;
+          }
+          else
+            idx++;
+        }
+      }
+
+      changed |= hoisted;
+    }
+
+    return changed;
+  }
+
+  bool run(WhileFunction &f) override
+  {
+    bool changed = insertPreheaders(f);
+
+    // Hoisting does not modify the control-flow graph, the liveness remains a
+    // conservative approximation.
+    const WhileLoopForest &LF = f.loops();
+    WhileLiveness WL(f);
+    for(auto l = LF.Loops.rbegin(); l != LF.Loops.rend(); l++)
+      changed |= hoist(f, **l, WL);
+
+    return changed;
+  }
+
+  WhileLoopInvariantCodeMotion() : WhileFunctionPass("licm",
+                                                     "Loop-invariant code motion")
+  {
+  }
+};
+
+WhileLoopInvariantCodeMotion WLICM;
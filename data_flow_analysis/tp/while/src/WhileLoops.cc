@@ -0,0 +1,181 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements the computation of the loop nesting forest. A natural
+// loop is formed by the back edges to a header, i.e., edges whose target
+// dominates their source, and the blocks reaching these edges without passing
+// through the header.
+
+#include "WhileLoops.h"
+
+#include <algorithm>
+
+WhileLoopForest::WhileLoopForest(const WhileFunction &f,
+                                 const WhileDominatorTree &DT)
+  : InnermostLoop(f.Body.size())
+{
+  assert(!DT.Post && "Loops are computed from the dominator tree");
+
+  // Headers dominate the blocks of their loop, visiting them in reverse
+  // post-order thus finds outer loops first.
+  for(WhileBlock *header : DT.ReversePostOrder)
+  {
+    std::vector<WhileBlock*> latches;
+    for(const auto &[pred, kind] : header->Pred)
+      if (DT.dominates(header, pred))
+        latches.emplace_back(pred);
+
+    if (latches.empty())
+      continue;
+
+    auto loop = std::make_unique<WhileLoop>();
+    loop->Header = header;
+    loop->Latches = latches;
+    loop->Member.resize(f.Body.size());
+    loop->Member[header->Index] = true;
+
+    std::vector<WhileBlock*> worklist = latches;
+    while (!worklist.empty())
+    {
+      WhileBlock *bb = worklist.back();
+      worklist.pop_back();
+      if (loop->Member[bb->Index])
+        continue;
+
+      loop->Member[bb->Index] = true;
+      for(const auto &[pred, kind] : bb->Pred)
+        if (DT.isReachable(pred) && !loop->Member[pred->Index])
+          worklist.emplace_back(pred);
+    }
+
+    for(WhileBlock *bb : DT.ReversePostOrder)
+    {
+      if (!loop->contains(bb))
+        continue;
+
+      loop->Blocks.emplace_back(bb);
+      for(WhileBlock *succ : bb->Succ)
+        if (succ && !loop->contains(succ))
+          loop->Exits.emplace_back(bb, succ);
+    }
+
+    loop->Parent = InnermostLoop[header->Index];
+    if (loop->Parent)
+    {
+      loop->Depth = loop->Parent->Depth + 1;
+      loop->Parent->Children.emplace_back(loop.get());
+    }
+    else
+      TopLevel.emplace_back(loop.get());
+
+    for(WhileBlock *bb : loop->Blocks)
+      InnermostLoop[bb->Index] = loop.get();
+
+    Loops.emplace_back(std::move(loop));
+  }
+}
+
+std::ostream &WhileLoop::dump(std::ostream &s) const
+{
+  s << std::string(2 * Depth, ' ') << "loop BB" << Header->Index << ":";
+  for(const WhileBlock *bb : Blocks)
+    s << " BB" << bb->Index;
+
+  s << " latches:";
+  for(const WhileBlock *bb : Latches)
+    s << " BB" << bb->Index;
+
+  s << " exits:";
+  for(const auto &[from, to] : Exits)
+    s << " BB" << from->Index << "->BB" << to->Index;
+
+  s << "\n";
+  for(const WhileLoop *child : Children)
+    child->dump(s);
+
+  return s;
+}
+
+std::ostream &WhileLoopForest::dump(std::ostream &s) const
+{
+  for(const WhileLoop *l : TopLevel)
+    l->dump(s);
+
+  return s;
+}
+
+const WhileLoopForest &WhileFunction::loops() const
+{
+  if (!Loops.Result || Loops.Version != CFGVersion)
+  {
+    Loops.Result = std::make_shared<WhileLoopForest>(*this, dominators());
+    Loops.Version = CFGVersion;
+  }
+
+  return *Loops.Result;
+}
+
+static bool isPreheader(const WhileBlock *pred, const WhileBlock *header)
+{
+  return (pred->Succ[WFALL_THROUGH] == header && !pred->Succ[WBRANCH_TAKEN]) ||
+         (pred->Succ[WBRANCH_TAKEN] == header && !pred->Succ[WFALL_THROUGH]);
+}
+
+WhileBlock *preheader(const WhileLoop &loop)
+{
+  for(const auto &[pred, kind] : loop.Header->Pred)
+    if (!loop.contains(pred))
+      return pred;
+
+  abort();
+}
+
+bool insertPreheaders(WhileFunction &f)
+{
+  std::vector<std::pair<WhileBlock*, std::vector<WhileBlock*> > > headers;
+  for(const auto &loop : f.loops().Loops)
+  {
+    std::vector<WhileBlock*> outside;
+    for(const auto &[pred, kind] : loop->Header->Pred)
+      if (!loop->contains(pred) &&
+          std::find(outside.begin(), outside.end(), pred) == outside.end())
+        outside.emplace_back(pred);
+
+    headers.emplace_back(loop->Header, outside);
+  }
+
+  bool changed = false;
+  for(auto &[header, outside] : headers)
+  {
+    if (outside.size() == 1 && isPreheader(outside.front(), header))
+      continue;
+
+    WhileBlock *pre = f.createBlockBefore(header);
+    for(WhileBlock *pred : outside)
+      for(WhileSuccKind kind : {WFALL_THROUGH, WBRANCH_TAKEN})
+        if (pred->Succ[kind] == header)
+          pred->redirectEdge(kind, pre);
+
+    pre->addEdge(WFALL_THROUGH, header);
+    changed = true;
+  }
+
+  return changed;
+}
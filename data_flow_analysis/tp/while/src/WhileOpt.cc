@@ -0,0 +1,169 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This is the main file of a simple While optimizer. First command-line
+// arguments are processed, then the While input code is parsed, a control-flow
+// graph is constructed, and, finally, the program is transformed by a pipeline
+// of passes and the resulting control-flow graph is printed.
+
+#include "WhilePass.h"
+#include "WhileLoops.h"
+#include "WhileLang.h"
+#include "WhileCFG.h"
+
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstring>
+
+#include "antlr4-runtime.h"
+#include "WhileParser.h"
+#include "WhileLexer.h"
+#include "WhileBaseListener.h"
+
+
+const char *WhileTypes[4] = {"int", "int *", "int[]", "unknown"};
+
+static void version()
+{
+  std::cout << "While  Copyright  2023  Florian Brandner\n"
+               "This program comes with ABSOLUTELY NO WARRANTY.\n"
+               "This is free software, and you are welcome to redistribute it "
+               "under certain conditions. See the license file in the source "
+               "distribution for more details.\n";
+}
+
+static void usage(const char *prog)
+{
+  std::cerr << "Usage: " << prog << "[-d] [-L] [-O<n>] [-s] [-u <profile>] "
+            << "[<pass> ...] <input.whl>\n\n"
+            << "\t-d\tDump control-flow graph before optimization.\n"
+            << "\t-L\tPrint loop nesting forests after optimization.\n"
+            << "\t-O<n>\tRun the optimization pipeline (-O0, -O1, -O2).\n"
+            << "\t-s\tPrint statistics of optimization passes.\n"
+            << "\t-u\tUse a profile written by while-run -p.\n"
+            << "\t-n\tDo not verify the program after each pass.\n"
+            << "\t-l\tPrint list of available passes.\n"
+            << "\t-v\tPrint version and license information.\n\n"
+            << "Optimization levels and passes given by name run in "
+            << "command-line order.\n\n";
+
+  version();
+  exit(3);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+    usage(argv[0]);
+
+  bool dump = false;
+  bool loops = false;
+  std::string filename = argv[argc-1];
+  std::string useprofile;
+  WhilePassManager PM;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if (!std::strcmp(argv[i], "-l"))
+    {
+      std::cout << "List of available passes:\n";
+      for(const auto&[name, p] : WhilePasses)
+        std::cout << "  " << std::left << std::setw(10) << name << std::right
+                  << p->Description << "\n";
+
+      return 0;
+    }
+  }
+
+  for(int i = 1; i < argc-1; i++)
+  {
+    if (!std::strcmp(argv[i], "-d"))
+      dump = true;
+    else if (!std::strcmp(argv[i], "-L"))
+      loops = true;
+    else if (!std::strcmp(argv[i], "-s"))
+      PM.Stats = true;
+    else if (!std::strcmp(argv[i], "-n"))
+      PM.Verify = false;
+    else if (!std::strcmp(argv[i], "-u") && i + 2 < argc)
+      useprofile = argv[++i];
+    else if (!std::strncmp(argv[i], "-O", 2) && argv[i][2] >= '0' &&
+             argv[i][2] < (char)('0' + WhilePipelines.size()) && !argv[i][3])
+      PM.addLevel(argv[i][2] - '0');
+    else if (!std::strcmp(argv[i], "-v"))
+      version();
+    else
+    {
+      auto p = WhilePasses.find(argv[i]);
+      if (p == WhilePasses.end())
+      {
+        std::cerr << "Pass '" << argv[i]
+                  << "' unknown. Use '-l' to display list of passes.\n\n";
+        return 1;
+      }
+      else
+        PM.add(p->second);
+    }
+  }
+
+  antlr4::ANTLRFileStream input(filename);
+  WhileLexer lexer(&input);
+  antlr4::CommonTokenStream tokens(&lexer);
+  WhileParser parser(&tokens);
+
+  antlr4::tree::ParseTree *tree = parser.program();
+
+  if (parser.getNumberOfSyntaxErrors() != 0)
+    return 1;
+
+  if (parser.Error)
+    return 2;
+
+  std::unique_ptr<WhileProgram> program = generateCode(tree);
+
+  if (!useprofile.empty())
+  {
+    std::ifstream profile(useprofile);
+    if (!readProfile(*program, profile))
+    {
+      std::cerr << "Profile '" << useprofile << "' does not match.\n";
+      return 1;
+    }
+  }
+
+  if (dump)
+    program->dump(std::cout);
+
+  PM.run(*program);
+  program->dump(std::cout);
+
+  if (loops)
+  {
+    for(const WhileFunction *f : program->FunctionsByIndex)
+    {
+      std::cout << "loops " << f->Name << ":\n";
+      f->loops().dump(std::cout);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,127 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements the registry of transformation passes and the pass
+// manager, which runs pipelines of passes and verifies the program after each
+// of them.
+
+#include "WhilePass.h"
+
+#include <cassert>
+#include <chrono>
+#include <iomanip>
+
+// Passes register themselves from their constructors, this file thus has to be
+// listed before the passes in the build.
+std::map<std::string, WhilePass*> WhilePasses;
+
+const std::vector<std::vector<const char *> > WhilePipelines =
+{
+  // -O0
+  {},
+  // -O1
+  {"constprop", "loadfwd", "copyprop", "dse", "tailcall", "dce",
+   "simplifycfg", "framelayout", "boundscheck", "layout"},
+  // -O2
+  {"inline", "constprop", "specialize", "constprop", "copyprop", "licm",
+   "scalarrepl", "strength", "gvn", "loadfwd", "copyprop", "dse", "tailcall",
+   "dce", "simplifycfg", "framelayout", "boundscheck", "layout"},
+};
+
+WhilePass::WhilePass(const char *name, const char *descr, bool ssa)
+  : Name(name), Description(descr), HandlesSSA(ssa)
+{
+  WhilePasses.emplace(name, this);
+}
+
+unsigned int countInstructions(const WhileProgram &p)
+{
+  unsigned int result = 0;
+  for(const WhileFunction *f : p.FunctionsByIndex)
+    result += f->size();
+
+  return result;
+}
+
+void WhilePassManager::addLevel(unsigned int level)
+{
+  assert(level < WhilePipelines.size() && "Unknown optimization level.");
+  for(const char *name : WhilePipelines[level])
+  {
+    auto pass = WhilePasses.find(name);
+    assert(pass != WhilePasses.end() && "Unknown pass in pipeline.");
+    add(pass->second);
+  }
+}
+
+bool WhilePassManager::run(WhileProgram &p, std::ostream &s)
+{
+  typedef std::chrono::steady_clock clock;
+
+  if (Verify && !verifyProgram(p, std::cerr))
+  {
+    std::cerr << "Invalid control-flow graph after code generation.\n";
+    abort();
+  }
+
+  if (Stats)
+    s << std::left << std::setw(12) << "Pass" << std::right
+      << std::setw(12) << "Time (us)" << std::setw(10) << "Instrs"
+      << std::setw(10) << "Delta" << "\n";
+
+  bool changed = false;
+  unsigned int total = countInstructions(p);
+  double totaltime = 0;
+  for(WhilePass *pass : Pipeline)
+  {
+    unsigned int before = countInstructions(p);
+    auto start = clock::now();
+
+    changed |= pass->run(p);
+
+    std::chrono::duration<double, std::micro> time = clock::now() - start;
+    unsigned int after = countInstructions(p);
+    totaltime += time.count();
+
+    if (Stats)
+      s << std::left << std::setw(12) << pass->Name << std::right
+        << std::setw(12) << std::fixed << std::setprecision(1) << time.count()
+        << std::setw(10) << after
+        << std::setw(10) << (int)after - (int)before << "\n";
+
+    if (Verify && !verifyProgram(p, std::cerr))
+    {
+      std::cerr << "Invalid control-flow graph after pass '" << pass->Name
+                << "'.\n";
+      abort();
+    }
+  }
+
+  if (Stats)
+  {
+    unsigned int after = countInstructions(p);
+    s << std::left << std::setw(12) << "total" << std::right
+      << std::setw(12) << std::fixed << std::setprecision(1) << totaltime
+      << std::setw(10) << after
+      << std::setw(10) << (int)after - (int)total << "\n";
+  }
+
+  return changed;
+}
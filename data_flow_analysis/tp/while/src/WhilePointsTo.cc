@@ -0,0 +1,400 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file implements the points-to analysis. Instructions are translated into
+// inclusion constraints between the nodes of a graph, loads and stores adding
+// edges from and to the locations their address may point to. The constraints
+// are solved with a worklist, strongly connected components of the graph are
+// merged into a single node whenever new edges were added.
+
+#include "WhilePointsTo.h"
+
+#include <algorithm>
+#include <utility>
+
+WhilePointsTo::WhilePointsTo(const WhileProgram &p)
+  : P(p)
+{
+  auto addLocation = [&](const WhileSymbol *sym) {
+    if (LocationIndex.emplace(sym, Locations.size()).second)
+      Locations.emplace_back(sym);
+  };
+
+  for(const auto &[name, sym] : p.Globals)
+    addLocation(sym);
+
+  for(const WhileFunction *f : p.FunctionsByIndex)
+    for(const WhileFrameObject &obj : f->FrameObjects)
+      addLocation(obj.Symbol);
+
+  for(unsigned int l = 0; l < Locations.size(); l++)
+    createNode();
+
+  for(const WhileFunction *f : p.FunctionsByIndex)
+  {
+    RegisterBase.emplace_back(Sets.size());
+    for(unsigned int r = 0; r < f->NumRegisters; r++)
+      createNode();
+  }
+
+  for(unsigned int f = 0; f < p.FunctionsByIndex.size(); f++)
+    ReturnNodes.emplace_back(createNode());
+
+  EscapeNode = createNode();
+  for(const WhileFunction *f : p.FunctionsByIndex)
+  {
+    for(const WhileBlock *bb : f->Body)
+    {
+      for(const WhileInstr *phi : bb->Phis)
+        addInstr(*f, *phi);
+      for(const WhileInstr *instr : bb->Body)
+        addInstr(*f, *instr);
+    }
+  }
+
+  for(unsigned int n = 0; n < Sets.size(); n++)
+    WorkList.emplace_back(n);
+
+  do
+  {
+    NewEdges = false;
+    collapseCycles();
+    solve();
+  } while (NewEdges);
+
+  for(unsigned int n = 0; n < Rep.size(); n++)
+    find(n);
+
+  Escaping = Sets[Rep[EscapeNode]];
+  for(unsigned int loc = 0; loc < Locations.size(); loc++)
+    Escaping.merge(contents(loc));
+}
+
+WhileBitSet WhilePointsTo::frameLocations(const WhileFunction &f,
+                                          int slot) const
+{
+  WhileBitSet result;
+  for(const WhileFrameObject &obj : f.FrameObjects)
+    if (slot >= (int)obj.Offset && slot < (int)(obj.Offset + obj.Size))
+      result.insert(LocationIndex.at(obj.Symbol));
+
+  if (result.empty())
+    for(const WhileFrameObject &obj : f.FrameObjects)
+      result.insert(LocationIndex.at(obj.Symbol));
+
+  return result;
+}
+
+unsigned int WhilePointsTo::createNode()
+{
+  unsigned int n = Sets.size();
+  Sets.emplace_back();
+  Rep.emplace_back(n);
+  Succs.emplace_back();
+  Loads.emplace_back();
+  Stores.emplace_back();
+  return n;
+}
+
+unsigned int WhilePointsTo::find(unsigned int n)
+{
+  while (Rep[n] != Rep[Rep[n]])
+    Rep[n] = Rep[Rep[n]];
+
+  return Rep[n];
+}
+
+// Merge node b into node a, both are representatives.
+void WhilePointsTo::merge(unsigned int a, unsigned int b)
+{
+  Rep[b] = a;
+  Sets[a].merge(Sets[b]);
+  Succs[a].insert(Succs[a].end(), Succs[b].begin(), Succs[b].end());
+  Loads[a].insert(Loads[a].end(), Loads[b].begin(), Loads[b].end());
+  Stores[a].insert(Stores[a].end(), Stores[b].begin(), Stores[b].end());
+  Sets[b] = WhileBitSet();
+  Succs[b].clear();
+  Loads[b].clear();
+  Stores[b].clear();
+}
+
+bool WhilePointsTo::addEdge(unsigned int from, unsigned int to)
+{
+  from = find(from);
+  to = find(to);
+  if (from == to || !Edges.insert((uint64_t)from << 32 | to).second)
+    return false;
+
+  Succs[from].emplace_back(to);
+  NewEdges = true;
+  if (Sets[to].merge(Sets[from]))
+    WorkList.emplace_back(to);
+
+  return true;
+}
+
+void WhilePointsTo::addGlobal(unsigned int n, int addr)
+{
+  for(const auto &[name, sym] : P.Globals)
+    if (addr >= (int)sym->Offset && addr < (int)(sym->Offset + sym->Size))
+      Sets[n].insert(LocationIndex.at(sym));
+}
+
+void WhilePointsTo::addOperand(unsigned int n, const WhileInstr &instr,
+                               unsigned int idx)
+{
+  const WhileOperand &op = instr.Ops[idx];
+  switch (op.Kind)
+  {
+    case WREGISTER:
+      addEdge(RegisterBase[instr.Block->Function->Index] + op.ValueOrIndex, n);
+      break;
+    case WFRAMEPOINTER:
+    {
+      int offs = instr.frameOffset(idx);
+      Sets[n].merge(frameLocations(*instr.Block->Function,
+                                   offs >= 0 ? instr.Ops[offs].ValueOrIndex :
+                                               -1));
+      break;
+    }
+    case WIMMEDIATE:
+      // Constants without a global symbol may be addresses of globals whose
+      // symbol was lost or is stale, e.g., after constant propagation.
+      if (op.Symbol && op.Symbol->Global)
+        Sets[n].insert(LocationIndex.at(op.Symbol));
+      else
+        addGlobal(n, op.ValueOrIndex);
+      break;
+
+    case WBLOCK:
+    case WFUNCTION:
+    case WUNKNOWN:
+      assert("Operand is not a data value.");
+  }
+}
+
+void WhilePointsTo::addInstr(const WhileFunction &f, const WhileInstr &instr)
+{
+  unsigned int regs = RegisterBase[f.Index];
+  const WhileOperand *def = instr.def();
+  unsigned int dst = def ? regs + def->ValueOrIndex : 0;
+
+  // Addresses are computed from two operands, when both are immediates, their
+  // sum may be the address of a global as well.
+  auto address = [&](unsigned int n, unsigned int a, unsigned int b) {
+    const WhileOperand &opa = instr.Ops[a];
+    const WhileOperand &opb = instr.Ops[b];
+    if (opa.isImm() && opb.isImm())
+      addGlobal(n, instr.Opc == WMINUS ? opa.ValueOrIndex - opb.ValueOrIndex :
+                                         opa.ValueOrIndex + opb.ValueOrIndex);
+
+    addOperand(n, instr, a);
+    addOperand(n, instr, b);
+  };
+
+  switch (instr.Opc)
+  {
+    case WPHI:
+      for(unsigned int idx = 1; idx < instr.Ops.size(); idx++)
+        addOperand(dst, instr, idx);
+      break;
+
+    case WLOAD:
+    {
+      unsigned int access = createNode();
+      AccessNodes.emplace(&instr, access);
+      address(access, 1, 2);
+      Loads[access].emplace_back(dst);
+      break;
+    }
+    case WSTORE:
+    {
+      unsigned int access = createNode();
+      unsigned int value = createNode();
+      AccessNodes.emplace(&instr, access);
+      address(access, 0, 1);
+      addOperand(value, instr, 2);
+      Stores[access].emplace_back(value);
+      break;
+    }
+    case WCALL:
+    {
+      // Addresses passed to any function escape, builtins may read through
+      // them, e.g., printstring.
+      for(unsigned int arg = 2; arg < instr.Ops.size(); arg++)
+        addOperand(EscapeNode, instr, arg);
+
+      int callee = instr.Ops[0].ValueOrIndex;
+      if (callee < 0)
+        break;
+
+      // Parameters are passed in registers, or stored in the frame of the
+      // callee.
+      const WhileFunction &g = *P.FunctionsByIndex[callee];
+      for(unsigned int arg = 0; arg + 2 < instr.Ops.size(); arg++)
+      {
+        int reg = g.ParameterRegisters[arg];
+        if (reg >= 0)
+        {
+          addOperand(RegisterBase[callee] + reg, instr, arg + 2);
+          continue;
+        }
+
+        unsigned int value = createNode();
+        addOperand(value, instr, arg + 2);
+        for(unsigned int loc : frameLocations(g, arg).elements())
+          addEdge(value, loc);
+      }
+
+      addEdge(ReturnNodes[callee], dst);
+      break;
+    }
+    case WRETURN:
+      addOperand(ReturnNodes[f.Index], instr, 0);
+      addOperand(EscapeNode, instr, 0);
+      break;
+
+    case WPLUS:
+    case WMINUS:
+    case WMULT:
+    case WDIV:
+    case WEQUAL:
+    case WUNEQUAL:
+    case WLESS:
+    case WLESSEQUAL:
+      address(dst, 1, 2);
+      break;
+
+    case WBRANCHZ:
+    case WBRANCH:
+      break;
+  }
+}
+
+// Merge the nodes of each strongly connected component of the inclusion edges,
+// using Tarjan's algorithm on the representatives.
+void WhilePointsTo::collapseCycles()
+{
+  unsigned int n = Sets.size();
+  const unsigned int unvisited = -1;
+  std::vector<unsigned int> number(n, unvisited);
+  std::vector<unsigned int> lowlink(n);
+  std::vector<bool> onstack(n);
+  std::vector<unsigned int> members;
+  unsigned int next = 0;
+  for(unsigned int root = 0; root < n; root++)
+  {
+    if (find(root) != root || number[root] != unvisited)
+      continue;
+
+    std::vector<std::pair<unsigned int, unsigned int> > stack;
+    stack.emplace_back(root, 0);
+    number[root] = lowlink[root] = next++;
+    members.emplace_back(root);
+    onstack[root] = true;
+    while (!stack.empty())
+    {
+      auto &[node, succ] = stack.back();
+      if (succ < Succs[node].size())
+      {
+        unsigned int s = find(Succs[node][succ++]);
+        if (number[s] == unvisited)
+        {
+          number[s] = lowlink[s] = next++;
+          members.emplace_back(s);
+          onstack[s] = true;
+          stack.emplace_back(s, 0);
+        }
+        else if (onstack[s])
+          lowlink[node] = std::min(lowlink[node], number[s]);
+
+        continue;
+      }
+
+      unsigned int done = node;
+      stack.pop_back();
+      if (!stack.empty())
+      {
+        unsigned int parent = stack.back().first;
+        lowlink[parent] = std::min(lowlink[parent], lowlink[done]);
+      }
+
+      if (lowlink[done] != number[done])
+        continue;
+
+      unsigned int member = unvisited;
+      while (member != done)
+      {
+        member = members.back();
+        members.pop_back();
+        onstack[member] = false;
+        if (member != done)
+        {
+          merge(done, member);
+          WorkList.emplace_back(done);
+        }
+      }
+    }
+  }
+
+  // Drop edges within merged nodes and duplicates.
+  Edges.clear();
+  for(unsigned int node = 0; node < n; node++)
+  {
+    if (find(node) != node)
+      continue;
+
+    std::vector<unsigned int> succs;
+    for(unsigned int s : Succs[node])
+      if (find(s) != node &&
+          Edges.insert((uint64_t)node << 32 | find(s)).second)
+        succs.emplace_back(find(s));
+
+    Succs[node] = std::move(succs);
+  }
+}
+
+void WhilePointsTo::solve()
+{
+  while (!WorkList.empty())
+  {
+    unsigned int node = find(WorkList.back());
+    WorkList.pop_back();
+
+    // Loads and stores through the node add edges from and to the locations it
+    // points to.
+    for(unsigned int loc : Sets[node].elements())
+    {
+      for(unsigned int i = 0; i < Loads[node].size(); i++)
+        addEdge(loc, Loads[node][i]);
+      for(unsigned int i = 0; i < Stores[node].size(); i++)
+        addEdge(Stores[node][i], loc);
+    }
+
+    node = find(node);
+    for(unsigned int i = 0; i < Succs[node].size(); i++)
+    {
+      unsigned int s = find(Succs[node][i]);
+      if (s != node && Sets[s].merge(Sets[node]))
+        WorkList.emplace_back(s);
+    }
+  }
+}
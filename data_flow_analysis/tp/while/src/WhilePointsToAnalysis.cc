@@ -0,0 +1,99 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file implements an analysis displaying the results of the points-to
+// analysis, i.e., the locations whose address may be held by each register
+// defined in a function and the locations accessed by loads and stores.
+
+#include "WhileAnalysis.h"
+#include "WhilePointsTo.h"
+
+struct WhilePointsToAnalysis : public WhileAnalysis
+{
+  static void dump(std::ostream &s, const WhilePointsTo &PTA,
+                   const WhileBitSet &locs)
+  {
+    s << "{";
+    bool first = true;
+    for(unsigned int loc : locs.elements())
+    {
+      s << (first ? "" : ", ") << *PTA.Locations[loc]->Name;
+      first = false;
+    }
+    s << "}";
+  }
+
+  static void dump(std::ostream &s, const WhilePointsTo &PTA,
+                   const WhileFunction &f, const WhileInstr &instr)
+  {
+    s << std::setw(4) << instr.Index << ": ";
+    instr.dump(s);
+
+    const WhileOperand *def = instr.def();
+    if (instr.Opc == WLOAD || instr.Opc == WSTORE)
+    {
+      s << "  # accesses ";
+      dump(s, PTA, PTA.accessed(instr));
+    }
+
+    if (def && !PTA.pointsTo(f, def->ValueOrIndex).empty())
+    {
+      s << "  # ";
+      def->dump(s) << " -> ";
+      dump(s, PTA, PTA.pointsTo(f, def->ValueOrIndex));
+    }
+
+    s << "\n";
+  }
+
+  void analyze(const WhileProgram &p) override
+  {
+    WhilePointsTo PTA(p);
+
+    std::cout << "Locations:\n";
+    for(unsigned int loc = 0; loc < PTA.Locations.size(); loc++)
+    {
+      std::cout << "  " << *PTA.Locations[loc]->Name << " -> ";
+      dump(std::cout, PTA, PTA.contents(loc));
+      std::cout << "\n";
+    }
+
+    for(const auto &[name, f] : p.Functions)
+    {
+      f.dumphead(std::cout) << "\n";
+      for(const WhileBlock *bb : f.Body)
+      {
+        bb->dumphead(std::cout) << "\n";
+        for(const WhileInstr *phi : bb->Phis)
+          dump(std::cout, PTA, f, *phi);
+
+        for(const WhileInstr *instr : bb->Body)
+          dump(std::cout, PTA, f, *instr);
+      }
+    }
+  }
+
+  WhilePointsToAnalysis() : WhileAnalysis("WPTA", "Points-to analysis")
+  {
+  }
+};
+
+WhilePointsToAnalysis WPTA;
@@ -20,10 +20,15 @@
 
 // This is the main file of a simple While interpreter. First command-line
 // arguments are processed, then the While input code is parsed, a control-flow
-// graph is constructed, and, finally, the interpreter executes the program.
+// graph is constructed and optimized, and, finally, the interpreter executes
+// the program.
 
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
 #include <cstring>
 #include <list>
 
@@ -34,7 +39,9 @@
 
 #include "WhileLang.h"
 #include "WhileCFG.h"
+#include "WhileCallGraph.h"
 #include "WhileInterpreter.h"
+#include "WhilePass.h"
 
 const char *WhileTypes[4] = {"int", "int *", "int[]", "unknown"};
 
@@ -49,10 +56,20 @@ static void version()
 
 static void usage(const char *prog)
 {
-  std::cerr << "Usage: " << prog << "[-t] [-d] <input.whl>\n\n"
+  std::cerr << "Usage: " << prog << "[-t] [-d] [-O<n>] [-s] [-p <profile>] "
+            << "[-u <profile>] [-r <depth>] [<pass> ...] <input.whl>\n\n"
             << "\t-t\tTrace instructions while interpreting.\n"
             << "\t-d\tDump control-flow graph.\n"
-            << "\t-v\tPrint version and license information.\n\n";
+            << "\t-O<n>\tOptimize the program (-O0, -O1, -O2).\n"
+            << "\t-s\tPrint statistics of optimization passes.\n"
+            << "\t-p\tWrite block and edge execution counts to a profile, use "
+            << "with -O0.\n"
+            << "\t-u\tUse a profile written by -p for optimization.\n"
+            << "\t-r\tAssume recursive calls nest at most <depth> times when "
+            << "sizing the stack.\n"
+            << "\t-v\tPrint version and license information.\n\n"
+            << "Optimization levels and passes given by name run in "
+            << "command-line order.\n\n";
 
   version();
   exit(3);
@@ -66,6 +83,10 @@ int main(int argc, char *argv[])
   bool dump = false;
   bool trace = false;
   std::string filename = argv[argc-1];
+  std::string writeprofile;
+  std::string useprofile;
+  unsigned int recursion = 0;
+  WhilePassManager PM;
 
   for(int i = 1; i < argc-1; i++)
   {
@@ -73,8 +94,29 @@ int main(int argc, char *argv[])
       trace = true;
     else if (!std::strcmp(argv[i], "-d"))
       dump = true;
+    else if (!std::strcmp(argv[i], "-s"))
+      PM.Stats = true;
+    else if (!std::strcmp(argv[i], "-p") && i + 2 < argc)
+      writeprofile = argv[++i];
+    else if (!std::strcmp(argv[i], "-u") && i + 2 < argc)
+      useprofile = argv[++i];
+    else if (!std::strcmp(argv[i], "-r") && i + 2 < argc)
+    {
+      char *end;
+      unsigned long depth = std::strtoul(argv[++i], &end, 10);
+      if (!std::isdigit((unsigned char)argv[i][0]) || *end ||
+          depth > UINT_MAX)
+        usage(argv[0]);
+
+      recursion = depth;
+    }
+    else if (!std::strncmp(argv[i], "-O", 2) && argv[i][2] >= '0' &&
+             argv[i][2] < (char)('0' + WhilePipelines.size()) && !argv[i][3])
+      PM.addLevel(argv[i][2] - '0');
     else if (!std::strcmp(argv[i], "-v"))
       version();
+    else if (WhilePasses.count(argv[i]))
+      PM.add(WhilePasses[argv[i]]);
     else
       usage(argv[0]);
   }
@@ -92,13 +134,46 @@ int main(int argc, char *argv[])
   if (parser.Error)
     return 2;
 
-  WhileProgram *program = generateCode(tree);
+  std::unique_ptr<WhileProgram> program = generateCode(tree);
+
+  if (!useprofile.empty())
+  {
+    std::ifstream profile(useprofile);
+    if (!readProfile(*program, profile))
+    {
+      std::cerr << "Profile '" << useprofile << "' does not match.\n";
+      return 1;
+    }
+  }
+
+  if (!PM.empty())
+    PM.run(*program);
 
   if (dump)
     program->dump(std::cout);
 
-  WhileState s(program);
+  // Allocate the stack needed by the frames of the program, the stack grows
+  // beyond when recursion is unbounded or deeper than assumed.
+  unsigned int stacksize = 1024;
+  const auto main = program->Functions.find("main");
+  if (main != program->Functions.end())
+  {
+    long depth = WhileCallGraph(*program).stackDepth(main->second, recursion);
+    if (depth >= 0)
+      stacksize = depth;
+  }
+
+  WhileState s(program.get(), stacksize);
+  if (!writeprofile.empty())
+    s.enableProfile();
+
   s.run(trace);
 
+  if (!writeprofile.empty())
+  {
+    std::ofstream profile(writeprofile);
+    s.dumpProfile(profile);
+  }
+
   return s.ExitState;
 }
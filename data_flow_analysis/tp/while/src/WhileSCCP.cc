@@ -0,0 +1,178 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file implements sparse conditional constant propagation. Two worklists
+// hold the edges found to be executable, and the registers whose value was
+// lowered. Each register is lowered at most twice, the work is thus
+// proportional to the number of def-use edges.
+
+#include "WhileSCCP.h"
+
+WhileSCCP::WhileSCCP(const WhileFunction &f, const WhileSSA &SSA)
+  : Values(SSA.Defs.size()), Executable(f.Body.size(), std::vector<bool>(2)),
+    Reachable(f.Body.size()), SSA(SSA)
+{
+  for(unsigned int r = 0; r < Values.size(); r++)
+    if (!SSA.Defs[r])
+      Values[r] = WhileConstValue(0);
+
+  for(int r : f.ParameterRegisters)
+    if (r >= 0)
+      Values[r] = WhileConstValue::bottom();
+
+  // The entry block is reached over a virtual edge.
+  visitBlock(f.Body.front());
+
+  while (!EdgeWorkList.empty() || !RegisterWorkList.empty())
+  {
+    if (!EdgeWorkList.empty())
+    {
+      auto [bb, kind] = EdgeWorkList.back();
+      EdgeWorkList.pop_back();
+
+      // Phis depend on the executable edges, the remaining instructions are
+      // only visited once the block is reached.
+      const WhileBlock *succ = bb->Succ[kind];
+      for(const WhileInstr *phi : succ->Phis)
+        visitPhi(*phi);
+
+      if (!Reachable[succ->Index])
+        visitBlock(succ);
+      continue;
+    }
+
+    unsigned int reg = RegisterWorkList.back();
+    RegisterWorkList.pop_back();
+    for(const WhileUse &use : SSA.Uses[reg])
+    {
+      if (!Reachable[use.Instr->Block->Index])
+        continue;
+      else if (use.Instr->Opc == WPHI)
+        visitPhi(*use.Instr);
+      else
+        visitInstr(*use.Instr);
+    }
+  }
+}
+
+WhileConstValue WhileSCCP::value(const WhileOperand &op) const
+{
+  switch (op.Kind)
+  {
+    case WREGISTER:
+      return Values[op.ValueOrIndex];
+    case WIMMEDIATE:
+      return WhileConstValue(op.ValueOrIndex);
+    case WFRAMEPOINTER:
+      return WhileConstValue::bottom();
+
+    case WBLOCK:
+    case WFUNCTION:
+    case WUNKNOWN:
+      assert("Operand is not a data value.");
+  }
+  abort();
+}
+
+void WhileSCCP::lower(unsigned int reg, const WhileConstValue &value)
+{
+  if (Values[reg] == value || value.Kind == WhileConstValue::TOP ||
+      Values[reg].Kind == WhileConstValue::BOTTOM)
+    return;
+
+  // Values only move down the lattice, conflicting constants give bottom.
+  if (Values[reg].Kind == WhileConstValue::TOP)
+    Values[reg] = value;
+  else
+    Values[reg] = WhileConstValue::bottom();
+
+  RegisterWorkList.emplace_back(reg);
+}
+
+void WhileSCCP::markEdge(const WhileBlock *bb, WhileSuccKind kind)
+{
+  if (!bb->Succ[kind] || Executable[bb->Index][kind])
+    return;
+
+  Executable[bb->Index][kind] = true;
+  EdgeWorkList.emplace_back(bb, kind);
+}
+
+void WhileSCCP::visitBlock(const WhileBlock *bb)
+{
+  Reachable[bb->Index] = true;
+  for(const WhileInstr *instr : bb->Body)
+    visitInstr(*instr);
+
+  if (bb->Body.empty())
+    markEdge(bb, WFALL_THROUGH);
+}
+
+void WhileSCCP::visitPhi(const WhileInstr &phi)
+{
+  const WhileBlock &bb = *phi.Block;
+  for(unsigned int p = 0; p < bb.Pred.size(); p++)
+  {
+    const auto &[pred, kind] = bb.Pred[p];
+    if (Executable[pred->Index][kind])
+      lower(phi.Ops[0].ValueOrIndex, value(phi.Ops[p + 1]));
+  }
+}
+
+void WhileSCCP::visitInstr(const WhileInstr &instr)
+{
+  const WhileBlock &bb = *instr.Block;
+  const WhileOperand *def = instr.def();
+  if (def && instr.isPure())
+  {
+    WhileConstValue a = value(instr.Ops[1]);
+    WhileConstValue b = value(instr.Ops[2]);
+
+    int result;
+    if (a.Kind == WhileConstValue::TOP || b.Kind == WhileConstValue::TOP)
+      return;
+    else if (a.Kind == WhileConstValue::CONSTANT &&
+             b.Kind == WhileConstValue::CONSTANT &&
+             evaluateBinary(instr.Opc, a.Value, b.Value, result))
+      lower(def->ValueOrIndex, WhileConstValue(result));
+    else
+      lower(def->ValueOrIndex, WhileConstValue::bottom());
+  }
+  else if (def)
+    lower(def->ValueOrIndex, WhileConstValue::bottom());
+  else if (instr.Opc == WBRANCHZ)
+  {
+    WhileConstValue cond = value(instr.Ops[0]);
+    if (cond.Kind == WhileConstValue::BOTTOM)
+    {
+      markEdge(&bb, WFALL_THROUGH);
+      markEdge(&bb, WBRANCH_TAKEN);
+    }
+    else if (cond.Kind == WhileConstValue::CONSTANT)
+      markEdge(&bb, cond.Value ? WFALL_THROUGH : WBRANCH_TAKEN);
+  }
+  else if (instr.Opc == WBRANCH)
+    markEdge(&bb, WBRANCH_TAKEN);
+
+  // Blocks without a branch fall through after their last instruction.
+  if (instr.Index + 1 == bb.Body.size() && !instr.isTerminator())
+    markEdge(&bb, WFALL_THROUGH);
+}
@@ -0,0 +1,318 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file implements the construction of SSA form, following Cytron et al.,
+// with phis pruned by liveness, the translation out of SSA form using parallel
+// copies, and the computation of def-use chains.
+
+#include "WhileSSA.h"
+#include "WhileDominators.h"
+#include "WhileLiveness.h"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+bool constructSSA(WhileFunction &f)
+{
+  bool changed = false;
+
+  // The entry block must not have predecessors, as phis would lack an operand
+  // for the values on entry of the function.
+  if (!f.Body.front()->Pred.empty())
+  {
+    WhileBlock *entry = f.Body.front();
+    f.createBlockBefore(entry)->addEdge(WFALL_THROUGH, entry);
+    changed = true;
+  }
+
+  std::vector<bool> keep(f.Body.size());
+  for(const WhileBlock *bb : f.Body)
+    keep[bb->Index] = f.dominators().isReachable(bb);
+
+  if (std::find(keep.begin(), keep.end(), false) != keep.end())
+  {
+    f.removeBlocks(keep);
+    changed = true;
+  }
+
+  // Place phis on the iterated dominance frontiers of the blocks defining each
+  // register, where the register is live.
+  unsigned int numregs = f.NumRegisters;
+  std::vector<std::vector<WhileBlock*> > defs(numregs);
+  for(WhileBlock *bb : f.Body)
+  {
+    for(const WhileInstr *instr : bb->Body)
+    {
+      const WhileOperand *def = instr->def();
+      if (def && (defs[def->ValueOrIndex].empty() ||
+                  defs[def->ValueOrIndex].back() != bb))
+        defs[def->ValueOrIndex].emplace_back(bb);
+    }
+  }
+
+  WhileLiveness WL(f);
+  const WhileDominanceFrontiers &DF = f.frontiers();
+  for(unsigned int r = 0; r < numregs; r++)
+  {
+    std::vector<bool> placed(f.Body.size());
+    std::vector<bool> queued(f.Body.size());
+    std::vector<WhileBlock*> worklist = defs[r];
+    for(const WhileBlock *bb : worklist)
+      queued[bb->Index] = true;
+
+    while (!worklist.empty())
+    {
+      WhileBlock *bb = worklist.back();
+      worklist.pop_back();
+      for(WhileBlock *frontier : DF.Frontier[bb->Index])
+      {
+        if (placed[frontier->Index] || !WL.LiveIn[frontier->Index][r])
+          continue;
+
+        frontier->createPhi(WhileOperand(WREGISTER, r));
+        placed[frontier->Index] = true;
+        changed = true;
+        if (!queued[frontier->Index])
+        {
+          queued[frontier->Index] = true;
+          worklist.emplace_back(frontier);
+        }
+      }
+    }
+  }
+
+  // Rename the definitions in a depth-first traversal of the dominator tree,
+  // keeping a stack of the current register of each original register. The
+  // traversal stack holds the blocks, and whether their children were visited.
+  std::vector<unsigned int> original(numregs);
+  std::vector<std::vector<unsigned int> > current(numregs);
+  for(unsigned int r = 0; r < numregs; r++)
+  {
+    original[r] = r;
+    current[r].emplace_back(r);
+  }
+
+  auto define = [&](WhileOperand &op, std::vector<unsigned int> &pushed) {
+    unsigned int r = original[op.ValueOrIndex];
+    op.ValueOrIndex = f.NumRegisters++;
+    original.emplace_back(r);
+    current[r].emplace_back(op.ValueOrIndex);
+    pushed.emplace_back(r);
+  };
+
+  const WhileDominatorTree &DT = f.dominators();
+  std::vector<std::vector<unsigned int> > pushed(f.Body.size());
+  std::vector<std::pair<WhileBlock*, bool> > stack;
+  stack.emplace_back(f.Body.front(), false);
+  while (!stack.empty())
+  {
+    auto [bb, visited] = stack.back();
+    stack.pop_back();
+    if (visited)
+    {
+      for(unsigned int r : pushed[bb->Index])
+        current[r].pop_back();
+      continue;
+    }
+
+    for(WhileInstr *phi : bb->Phis)
+      define(phi->Ops[0], pushed[bb->Index]);
+
+    for(WhileInstr *instr : bb->Body)
+    {
+      // Returns may read a phi instead of the result of a tail call, the calls
+      // are marked again by the tail-call elimination after leaving SSA form.
+      instr->TailCall = false;
+
+      for(unsigned int idx = 0; idx < instr->Ops.size(); idx++)
+      {
+        WhileOperand &op = instr->Ops[idx];
+        if (op.Kind == WREGISTER && instr->isUse(idx))
+          op.ValueOrIndex = current[original[op.ValueOrIndex]].back();
+      }
+
+      WhileOperand *def = instr->def();
+      if (def)
+      {
+        define(*def, pushed[bb->Index]);
+        changed = true;
+      }
+    }
+
+    for(unsigned int kind = WFALL_THROUGH; kind <= WBRANCH_TAKEN; kind++)
+    {
+      WhileBlock *succ = bb->Succ[kind];
+      if (!succ)
+        continue;
+
+      for(unsigned int p = 0; p < succ->Pred.size(); p++)
+      {
+        if (succ->Pred[p].Block != bb || succ->Pred[p].Kind != kind)
+          continue;
+
+        for(WhileInstr *phi : succ->Phis)
+        {
+          unsigned int r = original[phi->Ops[0].ValueOrIndex];
+          phi->Ops[p + 1] = WhileOperand(WREGISTER, current[r].back());
+        }
+      }
+    }
+
+    stack.emplace_back(bb, true);
+    const auto &children = DT.Children[bb->Index];
+    for(auto c = children.rbegin(); c != children.rend(); c++)
+      stack.emplace_back(*c, false);
+  }
+
+  f.invalidateCode();
+  return changed;
+}
+
+// Emit the parallel copies as a sequence of moves, such that no register is
+// overwritten before all copies reading it were emitted. Cycles are broken
+// with a fresh register.
+static void emitCopies(WhileFunction &f, WhileBlock *bb, unsigned int pos,
+                       const WhileInstr &phi,
+                       std::vector<std::pair<WhileOperand, WhileOperand> > copies)
+{
+  auto reads = [&](const WhileOperand &dst) {
+    for(const auto &[d, src] : copies)
+      if (src.Kind == WREGISTER && src.ValueOrIndex == dst.ValueOrIndex)
+        return true;
+    return false;
+  };
+
+  auto move = [&](const WhileOperand &dst, const WhileOperand &src) {
+    bb->insert(pos++, bb->createMove(phi, dst, src));
+  };
+
+  while (!copies.empty())
+  {
+    auto ready = std::find_if(copies.begin(), copies.end(),
+                              [&](const auto &copy) {
+                                return !reads(copy.first);
+                              });
+    if (ready != copies.end())
+    {
+      move(ready->first, ready->second);
+      copies.erase(ready);
+      continue;
+    }
+
+    // All destinations are read by other copies, save one of them.
+    WhileOperand dst = copies.front().first;
+    WhileOperand tmp(WREGISTER, f.NumRegisters++);
+    move(tmp, dst);
+    for(auto &[d, src] : copies)
+      if (src.Kind == WREGISTER && src.ValueOrIndex == dst.ValueOrIndex)
+        src = tmp;
+  }
+}
+
+bool destructSSA(WhileFunction &f)
+{
+  struct EdgeCopies
+  {
+    WhileBlock *From;
+    WhileSuccKind Kind;
+    WhileBlock *To;
+    const WhileInstr *Phi;
+    std::vector<std::pair<WhileOperand, WhileOperand> > Copies;
+  };
+
+  bool changed = false;
+  std::vector<EdgeCopies> edges;
+  for(WhileBlock *bb : f.Body)
+  {
+    if (bb->Phis.empty())
+      continue;
+
+    for(unsigned int p = 0; p < bb->Pred.size(); p++)
+    {
+      const auto &[pred, kind] = bb->Pred[p];
+      EdgeCopies edge{pred, kind, bb, bb->Phis.front(), {}};
+      for(const WhileInstr *phi : bb->Phis)
+      {
+        const WhileOperand &dst = phi->Ops[0];
+        const WhileOperand &src = phi->Ops[p + 1];
+        assert(src.isData() && "Undefined phi operand");
+        if (src.Kind != WREGISTER || src.ValueOrIndex != dst.ValueOrIndex)
+          edge.Copies.emplace_back(dst, src);
+      }
+
+      if (!edge.Copies.empty())
+        edges.emplace_back(std::move(edge));
+    }
+
+    bb->Phis.clear();
+    f.invalidateCode();
+    changed = true;
+  }
+
+  // Copies on edges from blocks with several successors are placed in a new
+  // block on the edge, otherwise at the end of the predecessor.
+  for(EdgeCopies &edge : edges)
+  {
+    WhileBlock *bb = edge.From;
+    unsigned int pos = bb->Body.size();
+    if (bb->Succ[WFALL_THROUGH] && bb->Succ[WBRANCH_TAKEN])
+    {
+      bb = f.createBlock();
+      edge.From->redirectEdge(edge.Kind, bb);
+      bb->addEdge(WFALL_THROUGH, edge.To);
+      pos = 0;
+    }
+    else if (pos && bb->Body.back()->isTerminator())
+      pos--;
+
+    emitCopies(f, bb, pos, *edge.Phi, edge.Copies);
+  }
+
+  return changed;
+}
+
+WhileSSA::WhileSSA(const WhileFunction &f)
+  : Defs(f.NumRegisters), Uses(f.NumRegisters)
+{
+  for(const WhileBlock *bb : f.Body)
+  {
+    for(const WhileInstrList *list : {&bb->Phis, &bb->Body})
+    {
+      for(WhileInstr *instr : *list)
+      {
+        const WhileOperand *def = instr->def();
+        if (def)
+        {
+          assert(!Defs[def->ValueOrIndex] && "Register defined twice");
+          Defs[def->ValueOrIndex] = instr;
+        }
+
+        for(unsigned int idx = 0; idx < instr->Ops.size(); idx++)
+        {
+          const WhileOperand &op = instr->Ops[idx];
+          if (op.Kind == WREGISTER && instr->isUse(idx))
+            Uses[op.ValueOrIndex].push_back(WhileUse{instr, idx});
+        }
+      }
+    }
+  }
+}
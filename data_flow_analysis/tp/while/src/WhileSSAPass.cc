@@ -0,0 +1,56 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file implements passes translating functions into and out of SSA form,
+// see WhileSSA.h. Programs have to leave SSA form before they are interpreted.
+
+#include "WhilePass.h"
+#include "WhileSSA.h"
+
+struct WhileSSAConstruction : public WhileFunctionPass
+{
+  bool run(WhileFunction &f) override
+  {
+    return constructSSA(f);
+  }
+
+  WhileSSAConstruction() : WhileFunctionPass("ssa", "Translation into SSA form")
+  {
+  }
+};
+
+WhileSSAConstruction WSSA;
+
+struct WhileSSADestruction : public WhileFunctionPass
+{
+  bool run(WhileFunction &f) override
+  {
+    return destructSSA(f);
+  }
+
+  WhileSSADestruction() : WhileFunctionPass("outofssa",
+                                            "Translation out of SSA form",
+                                            true)
+  {
+  }
+};
+
+WhileSSADestruction WOSSA;
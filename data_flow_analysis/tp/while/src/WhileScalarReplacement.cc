@@ -0,0 +1,531 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file implements store-to-load forwarding and the scalar replacement of
+// memory locations in loops.
+//
+// Forwarding visits the blocks in a pre-order traversal of the dominator tree.
+// The values stored or loaded before remain available within extended basic
+// blocks, a load of an available address is replaced by a copy of the value.
+//
+// Scalar replacement holds frame slots and globals accessed at a fixed address
+// in a register while a loop executes. The register is loaded in the
+// preheader, and written back on the exits of the loop if it was modified.
+//
+// Both rely on the points-to analysis to show that other accesses and calls do
+// not modify the location. Promoted locations must not be read by calls either,
+// including builtins reading through their pointer arguments.
+
+#include "WhilePass.h"
+#include "WhileDominators.h"
+#include "WhileLoops.h"
+#include "WhilePointsTo.h"
+
+#include <algorithm>
+#include <optional>
+#include <unordered_set>
+
+// A frame slot or global, given by its offset from the frame pointer or its
+// absolute address.
+struct WhileFixedAddress
+{
+  bool Frame;
+  int Address;
+
+  bool operator==(const WhileFixedAddress &o) const
+  {
+    return Frame == o.Frame && Address == o.Address;
+  }
+};
+
+struct WhileMemoryAccesses
+{
+  const WhileFunction &F;
+  const WhilePointsTo &PTA;
+
+  // The globals and the escaping locations, which called functions may access.
+  WhileBitSet Shared;
+
+  // The locations accessed by loads and stores created after the points-to
+  // analysis was computed.
+  std::unordered_map<const WhileInstr*, WhileBitSet> Created;
+
+  // The registers known to the points-to analysis.
+  unsigned int NumRegisters;
+
+  WhileMemoryAccesses(const WhileFunction &f, const WhilePointsTo &pta)
+    : F(f), PTA(pta), Shared(pta.Escaping), NumRegisters(f.NumRegisters)
+  {
+    for(const auto &[name, sym] : f.Program->Globals)
+      Shared.insert(PTA.LocationIndex.at(sym));
+  }
+
+  // The position of the base address operand of a load or store, the offset
+  // follows it.
+  static unsigned int address(const WhileInstr &instr)
+  {
+    return instr.Opc == WLOAD ? 1 : 0;
+  }
+
+  const WhileBitSet &accessed(const WhileInstr &instr) const
+  {
+    auto c = Created.find(&instr);
+    return c != Created.end() ? c->second : PTA.accessed(instr);
+  }
+
+  // The address of a load or store, if it is a frame slot or a global.
+  std::optional<WhileFixedAddress> fixed(const WhileInstr &instr) const
+  {
+    const WhileOperand &base = instr.Ops[address(instr)];
+    const WhileOperand &offs = instr.Ops[address(instr) + 1];
+    if (base.Kind == WFRAMEPOINTER || offs.Kind == WFRAMEPOINTER)
+    {
+      int idx = base.Kind == WFRAMEPOINTER ? address(instr) :
+                                             address(instr) + 1;
+      int slot = instr.frameOffset(idx);
+      if (slot < 0 || instr.Ops[slot].ValueOrIndex < 0 ||
+          instr.Ops[slot].ValueOrIndex >= (int)F.FrameSize)
+        return std::nullopt;
+
+      return WhileFixedAddress{true, instr.Ops[slot].ValueOrIndex};
+    }
+
+    int addr = base.ValueOrIndex + offs.ValueOrIndex;
+    if (!base.isImm() || !offs.isImm() || addr < 0 ||
+        addr >= (int)F.Program->DataSize)
+      return std::nullopt;
+
+    return WhileFixedAddress{false, addr};
+  }
+
+  // Check whether a call may modify any of the locations.
+  bool mayModify(const WhileInstr &call, const WhileBitSet &locs) const
+  {
+    // Builtins do not modify memory.
+    return call.Ops[0].ValueOrIndex >= 0 && locs.intersects(Shared);
+  }
+
+  // Check whether a call may read or modify any of the locations. Builtins
+  // read the memory their pointer arguments point to, e.g., printstring.
+  bool mayAccess(const WhileInstr &call, const WhileBitSet &locs) const
+  {
+    int callee = call.Ops[0].ValueOrIndex;
+    if (callee >= 0)
+      return locs.intersects(Shared);
+
+    for(const auto &[name, builtin] : WhileBuiltins)
+    {
+      if (builtin.Index != callee)
+        continue;
+
+      for(unsigned int arg = 0; arg < builtin.ParameterTypes.size(); arg++)
+      {
+        const WhileOperand &op = call.Ops[arg + 2];
+        if (builtin.ParameterTypes[arg] != WPTR)
+          continue;
+        else if (op.Kind != WREGISTER || op.ValueOrIndex >= (int)NumRegisters)
+        {
+          if (locs.intersects(Shared))
+            return true;
+        }
+        else if (locs.intersects(PTA.pointsTo(F, op.ValueOrIndex)))
+          return true;
+      }
+    }
+
+    return false;
+  }
+
+  // Create a load or store of the address accessed by instr, which accesses
+  // the same locations.
+  WhileInstr *createAccess(WhileBlock *bb, const WhileInstr &instr,
+                           WhileOpcode opc, const WhileOperand &reg)
+  {
+    WhileInstr *access = bb->createInstr(instr.Line, instr.OffsetOnLine, opc,
+                                         3);
+    unsigned int base = opc == WLOAD ? 1 : 0;
+    access->Ops[base] = instr.Ops[address(instr)];
+    access->Ops[base + 1] = instr.Ops[address(instr) + 1];
+    access->Ops[opc == WLOAD ? 0 : 2] = reg;
+    Created.emplace(access, accessed(instr));
+    return access;
+  }
+};
+
+static bool sameOperand(const WhileOperand &a, const WhileOperand &b)
+{
+  return a.Kind == b.Kind && a.ValueOrIndex == b.ValueOrIndex;
+}
+
+// Replace the instruction at position idx by a copy of the value.
+static void replaceByCopy(WhileBlock &bb, unsigned int idx,
+                          const WhileOperand &dst, const WhileOperand &value)
+{
+  bb.replace(idx, bb.createMove(*bb.Body[idx], dst, value));
+}
+
+struct WhileLoadForwarding : public WhilePass
+{
+  // A value known to be held in memory, as long as the registers of the
+  // address and the value are not modified.
+  struct Available
+  {
+    const WhileInstr *Access;
+    WhileOperand Base;
+    WhileOperand Offset;
+    WhileOperand Value;
+    std::optional<WhileFixedAddress> Fixed;
+  };
+
+  typedef std::vector<Available> WhileAvailableList;
+
+  struct ForwardingInfo
+  {
+    WhileMemoryAccesses MA;
+    const WhileDominatorTree &DT;
+
+    ForwardingInfo(const WhileFunction &f, const WhilePointsTo &PTA)
+      : MA(f, PTA), DT(f.dominators())
+    {
+    }
+
+    Available available(const WhileInstr &instr) const
+    {
+      unsigned int base = WhileMemoryAccesses::address(instr);
+      return Available{&instr, instr.Ops[base], instr.Ops[base + 1],
+                       instr.Ops[instr.Opc == WLOAD ? 0 : 2], MA.fixed(instr)};
+    }
+
+    static bool sameAddress(const Available &a, const Available &b)
+    {
+      if (a.Fixed && b.Fixed)
+        return *a.Fixed == *b.Fixed;
+
+      return sameOperand(a.Base, b.Base) && sameOperand(a.Offset, b.Offset);
+    }
+
+    // Check whether the accesses may refer to the same memory cell, while the
+    // registers of both addresses hold the same values.
+    bool mayAlias(const Available &a, const Available &b) const
+    {
+      if (a.Fixed && b.Fixed)
+        return *a.Fixed == *b.Fixed;
+      else if (sameOperand(a.Base, b.Base) && a.Offset.isImm() &&
+               b.Offset.isImm())
+        return a.Offset.ValueOrIndex == b.Offset.ValueOrIndex;
+
+      return MA.accessed(*a.Access).intersects(MA.accessed(*b.Access));
+    }
+
+    static bool isRegister(const WhileOperand &op, int reg)
+    {
+      return op.Kind == WREGISTER && op.ValueOrIndex == reg;
+    }
+
+    static bool readsAddress(const Available &a, int reg)
+    {
+      return isRegister(a.Base, reg) || isRegister(a.Offset, reg);
+    }
+
+    static bool reads(const Available &a, int reg)
+    {
+      return readsAddress(a, reg) || isRegister(a.Value, reg);
+    }
+
+    static void define(WhileAvailableList &avail, const WhileInstr &instr)
+    {
+      const WhileOperand *def = instr.def();
+      if (!def)
+        return;
+
+      int r = def->ValueOrIndex;
+      avail.erase(std::remove_if(avail.begin(), avail.end(),
+                                 [r](const Available &a) {
+                                   return reads(a, r);
+                                 }), avail.end());
+    }
+
+    bool visit(WhileBlock &bb, WhileAvailableList avail)
+    {
+      bool changed = false;
+      for(const WhileInstr *phi : bb.Phis)
+        define(avail, *phi);
+
+      for(unsigned int idx = 0; idx < bb.Body.size(); idx++)
+      {
+        WhileInstr &instr = *bb.Body[idx];
+        if (instr.Opc == WLOAD)
+        {
+          Available load = available(instr);
+          auto a = std::find_if(avail.begin(), avail.end(),
+                                [&](const Available &a) {
+                                  return sameAddress(a, load);
+                                });
+          if (a != avail.end())
+          {
+            replaceByCopy(bb, idx, instr.Ops[0], a->Value);
+            define(avail, instr);
+            changed = true;
+            continue;
+          }
+
+          define(avail, instr);
+          if (!readsAddress(load, load.Value.ValueOrIndex))
+            avail.emplace_back(load);
+        }
+        else if (instr.Opc == WSTORE)
+        {
+          Available store = available(instr);
+          avail.erase(std::remove_if(avail.begin(), avail.end(),
+                                     [&](const Available &a) {
+                                       return mayAlias(a, store);
+                                     }), avail.end());
+          avail.emplace_back(store);
+        }
+        else if (instr.Opc == WCALL)
+        {
+          avail.erase(std::remove_if(avail.begin(), avail.end(),
+                                     [&](const Available &a) {
+                                       return MA.mayModify(instr,
+                                                MA.accessed(*a.Access));
+                                     }), avail.end());
+          define(avail, instr);
+        }
+        else
+          define(avail, instr);
+      }
+
+      // Memory is unchanged when entering a successor reached from this block
+      // only.
+      for(WhileBlock *child : DT.Children[bb.Index])
+      {
+        bool single = child->Pred.size() == 1;
+        changed |= visit(*child, single ? avail : WhileAvailableList());
+      }
+
+      return changed;
+    }
+  };
+
+  bool run(WhileProgram &p) override
+  {
+    WhilePointsTo PTA(p);
+    bool changed = false;
+    for(WhileFunction *f : p.FunctionsByIndex)
+    {
+      if (!accepts(*f))
+        continue;
+
+      ForwardingInfo FI(*f, PTA);
+      changed |= FI.visit(*f->Body.front(), WhileAvailableList());
+    }
+
+    return changed;
+  }
+
+  WhileLoadForwarding() : WhilePass("loadfwd", "Store-to-load forwarding")
+  {
+  }
+};
+
+WhileLoadForwarding WLFWD;
+
+struct WhileScalarReplacement : public WhilePass
+{
+  // A location held in a register within a loop, along with its accesses.
+  struct Promotion
+  {
+    WhileFixedAddress Address;
+    std::vector<WhileInstr*> Accesses;
+    bool Stored = false;
+  };
+
+  static bool promote(WhileFunction &f, const WhileLoop &loop,
+                      WhileMemoryAccesses &MA)
+  {
+    std::vector<WhileInstr*> accesses;
+    std::vector<const WhileInstr*> calls;
+    bool returns = false;
+    for(WhileBlock *bb : loop.Blocks)
+    {
+      for(WhileInstr *instr : bb->Body)
+      {
+        if (instr->Opc == WLOAD || instr->Opc == WSTORE)
+          accesses.emplace_back(instr);
+        else if (instr->Opc == WCALL)
+          calls.emplace_back(instr);
+        else if (instr->Opc == WRETURN)
+          returns = true;
+      }
+    }
+
+    std::vector<Promotion> promotions;
+    for(WhileInstr *instr : accesses)
+    {
+      std::optional<WhileFixedAddress> addr = MA.fixed(*instr);
+      if (!addr)
+        continue;
+
+      auto p = std::find_if(promotions.begin(), promotions.end(),
+                            [&](const Promotion &p) {
+                              return p.Address == *addr;
+                            });
+      if (p == promotions.end())
+        p = promotions.insert(p, Promotion{*addr, {}});
+
+      p->Accesses.emplace_back(instr);
+      p->Stored |= instr->Opc == WSTORE;
+    }
+
+    // All other accesses and calls of the loop must not access the location.
+    // Returning leaves the frame, but globals have to be written back.
+    auto isPromotable = [&](const Promotion &p) {
+      const WhileBitSet &locs = MA.accessed(*p.Accesses.front());
+      if (returns && p.Stored && !p.Address.Frame)
+        return false;
+
+      for(const WhileInstr *call : calls)
+        if (MA.mayAccess(*call, locs))
+          return false;
+
+      // Accesses at other fixed addresses access other memory cells.
+      for(const WhileInstr *instr : accesses)
+        if (!MA.fixed(*instr) && MA.accessed(*instr).intersects(locs))
+          return false;
+
+      return true;
+    };
+
+    promotions.erase(std::remove_if(promotions.begin(), promotions.end(),
+                                    [&](const Promotion &p) {
+                                      return !isPromotable(p);
+                                    }), promotions.end());
+    if (promotions.empty())
+      return false;
+
+    // Find the exit edges before blocks are added to the function.
+    std::vector<std::pair<WhileBlock*, WhileSuccKind> > exits;
+    for(WhileBlock *bb : loop.Blocks)
+      for(WhileSuccKind kind : {WFALL_THROUGH, WBRANCH_TAKEN})
+        if (bb->Succ[kind] && !loop.contains(bb->Succ[kind]))
+          exits.emplace_back(bb, kind);
+
+    WhileBlock *pre = preheader(loop);
+    std::vector<std::pair<const WhileInstr*, WhileOperand> > writeBacks;
+    for(Promotion &p : promotions)
+    {
+      WhileOperand reg(WREGISTER, f.NumRegisters++);
+      const WhileInstr &first = *p.Accesses.front();
+      unsigned int pos = pre->Body.size();
+      if (pos && pre->Body.back()->isTerminator())
+        pos--;
+
+      WhileInstr *load = MA.createAccess(pre, first, WLOAD, reg);
+      pre->insert(pos, load);
+      for(WhileInstr *instr : p.Accesses)
+      {
+        WhileBlock &bb = *instr->Block;
+        if (instr->Opc == WLOAD)
+          replaceByCopy(bb, instr->Index, instr->Ops[0], reg);
+        else
+          replaceByCopy(bb, instr->Index, reg, instr->Ops[2]);
+      }
+
+      if (p.Stored)
+        writeBacks.emplace_back(load, reg);
+    }
+
+    // The values are stored at the start of the exit targets, edges to
+    // targets with several predecessors are split.
+    for(const auto &[from, kind] : exits)
+    {
+      if (writeBacks.empty())
+        break;
+
+      // The stores follow a call ending the exiting block, which is thus no
+      // longer a tail call.
+      if (!from->Body.empty())
+        from->Body.back()->TailCall = false;
+
+      WhileBlock *to = from->Succ[kind];
+      if (to->Pred.size() > 1)
+      {
+        WhileBlock *bb = f.createBlock();
+        from->redirectEdge(kind, bb);
+        bb->addEdge(WFALL_THROUGH, to);
+        to = bb;
+      }
+
+      for(unsigned int idx = 0; idx < writeBacks.size(); idx++)
+      {
+        const auto &[load, reg] = writeBacks[idx];
+        to->insert(idx, MA.createAccess(to, *load, WSTORE, reg));
+      }
+    }
+
+    return true;
+  }
+
+  bool run(WhileFunction &f, const WhilePointsTo &PTA)
+  {
+    bool changed = insertPreheaders(f);
+    WhileMemoryAccesses MA(f, PTA);
+
+    // Splitting exit edges modifies the loop forest, it is recomputed after
+    // each loop, starting with the innermost loops.
+    std::unordered_set<const WhileBlock*> done;
+    while (true)
+    {
+      const WhileLoopForest &LF = f.loops();
+      auto l = std::find_if(LF.Loops.rbegin(), LF.Loops.rend(),
+                            [&](const auto &l) {
+                              return !done.count(l->Header);
+                            });
+      if (l == LF.Loops.rend())
+        break;
+
+      done.insert((*l)->Header);
+      changed |= promote(f, **l, MA);
+    }
+
+    return changed;
+  }
+
+  // The points-to sets are computed once for the whole program, the accesses
+  // added by the pass are tracked by WhileMemoryAccesses.
+  bool run(WhileProgram &p) override
+  {
+    WhilePointsTo PTA(p);
+    bool changed = false;
+    for(WhileFunction *f : p.FunctionsByIndex)
+      if (accepts(*f))
+        changed |= run(*f, PTA);
+
+    return changed;
+  }
+
+  WhileScalarReplacement() : WhilePass("scalarrepl",
+                                       "Scalar replacement of memory in loops")
+  {
+  }
+};
+
+WhileScalarReplacement WSRA;
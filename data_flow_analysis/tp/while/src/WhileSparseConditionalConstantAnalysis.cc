@@ -0,0 +1,139 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+
+// This file implements an analysis displaying the results of sparse conditional
+// constant propagation, i.e., the value of each register defined in the
+// function and the blocks that are never executed, and a check comparing them to
+// the dense constant analysis used by constant propagation.
+
+#include "WhileAnalysis.h"
+#include "WhileConstAnalysis.h"
+#include "WhileSCCP.h"
+
+struct WhileSparseConditionalConstantAnalysis : public WhileAnalysis
+{
+  static void dump(std::ostream &s, const WhileSCCP &SCCP,
+                   const WhileInstr &instr)
+  {
+    s << std::setw(4) << instr.Index << ": ";
+    instr.dump(s);
+
+    const WhileOperand *def = instr.def();
+    if (def)
+    {
+      s << "  # ";
+      def->dump(s) << " = " << SCCP.Values[def->ValueOrIndex];
+    }
+
+    s << "\n";
+  }
+
+  void analyze(const WhileProgram &p) override
+  {
+    for(const auto &[name, f] : p.Functions)
+    {
+      WhileSSA SSA(f);
+      WhileSCCP SCCP(f, SSA);
+
+      f.dumphead(std::cout) << "\n";
+      for(const WhileBlock *bb : f.Body)
+      {
+        bb->dumphead(std::cout);
+        if (!SCCP.Reachable[bb->Index])
+        {
+          std::cout << "  # unreachable\n";
+          continue;
+        }
+
+        std::cout << "\n";
+        for(const WhileInstr *phi : bb->Phis)
+          dump(std::cout, SCCP, *phi);
+
+        for(const WhileInstr *instr : bb->Body)
+          dump(std::cout, SCCP, *instr);
+      }
+    }
+  }
+
+  WhileSparseConditionalConstantAnalysis() : WhileAnalysis("WSCCP",
+                              "Sparse conditional constant propagation", true)
+  {
+  }
+};
+
+WhileSparseConditionalConstantAnalysis WSCCP;
+
+struct WhileSparseConditionalConstantCheck : public WhileAnalysis
+{
+  // Report the register operands where sparse conditional constant propagation
+  // is less precise than the dense analysis, or finds another constant. It may
+  // only be more precise, from ignoring edges that are never executed.
+  void analyze(const WhileProgram &p) override
+  {
+    for(const auto &[name, f] : p.Functions)
+    {
+      WhileSSA SSA(f);
+      WhileSCCP SCCP(f, SSA);
+      WhileConstAnalysis WCA;
+      WCA.initialize(f);
+      WCA.iterate();
+
+      for(const WhileBlock *bb : f.Body)
+      {
+        if (!SCCP.Reachable[bb->Index])
+          continue;
+
+        WhileConstDomain state(WCA.join(bb));
+        for(const WhileInstr *instr : bb->Body)
+        {
+          for(unsigned int idx = 0; idx < instr->Ops.size(); idx++)
+          {
+            const WhileOperand &op = instr->Ops[idx];
+            if (op.Kind != WREGISTER || !instr->isUse(idx))
+              continue;
+
+            WhileConstValue dense = WhileConstAnalysis::readDataOperand(op,
+                                                                        state);
+            WhileConstValue sparse = SCCP.value(op);
+            if (sparse.Kind == WhileConstValue::TOP ||
+                (dense.Kind == WhileConstValue::CONSTANT && sparse != dense))
+            {
+              std::cout << "Disagreement in " << name << ", ";
+              bb->dumpshort(std::cout) << ": " << instr->Index << ": ";
+              instr->dump(std::cout) << "  # ";
+              op.dump(std::cout) << " = " << sparse << ", dense " << dense
+                                 << "\n";
+            }
+          }
+
+          state = WCA.transfer(*instr, state);
+        }
+      }
+    }
+  }
+
+  WhileSparseConditionalConstantCheck() : WhileAnalysis("WSCCPCHECK",
+           "Compare sparse conditional constants to the dense analysis", true)
+  {
+  }
+};
+
+WhileSparseConditionalConstantCheck WSCCPCHECK;
@@ -0,0 +1,266 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements the specialization of functions on constant arguments.
+// The call sites of a function are grouped by the constants they pass for the
+// parameters read by the function. When all call sites agree on a constant,
+// the function itself is specialized, otherwise a clone is created for each
+// group, within a budget on the code size. The function main is only cloned,
+// as the program is also entered there without a call. Specialized functions assign the
+// constants to their parameters on entry, constant propagation and dead code
+// elimination then simplify the code. Callers are not updated, they keep
+// passing the constants.
+
+#include "WhilePass.h"
+#include "WhileLiveness.h"
+
+#include <algorithm>
+#include <optional>
+
+struct WhileSpecialization : public WhilePass
+{
+  // Functions larger than MaxSize instructions are not cloned, all clones
+  // together add at most MaxGrowth times the size of the program.
+  static const unsigned int MaxSize = 200;
+  static constexpr double MaxGrowth = 0.5;
+
+  // Small programs may grow by MinBudget instructions.
+  static constexpr unsigned int MinBudget = 100;
+
+  // The constant passed for each parameter, if any.
+  typedef std::vector<std::optional<int> > Signature;
+
+  // Check whether a parameter passed in memory is overwritten at the start of
+  // the entry block, e.g., after a previous specialization.
+  static bool isAssigned(const WhileFunction &g, unsigned int arg)
+  {
+    for(const WhileInstr *instr : g.Body.front()->Body)
+    {
+      if (instr->Opc == WSTORE && instr->Ops[0].Kind == WFRAMEPOINTER &&
+          instr->Ops[1].isImm() && instr->Ops[1].ValueOrIndex == (int)arg)
+        return true;
+      else if (instr->Opc == WLOAD || instr->Opc == WCALL)
+        return false;
+    }
+
+    return false;
+  }
+
+  // The constant arguments of a call for the parameters read by the callee.
+  static Signature signature(const WhileInstr &call, const WhileFunction &g,
+                             const WhileRegisterSet &livein)
+  {
+    Signature result;
+    for(unsigned int arg = 0; arg < g.ParameterRegisters.size(); arg++)
+    {
+      const WhileOperand &op = call.Ops[arg + 2];
+      int reg = g.ParameterRegisters[arg];
+      if (op.isImm() && (reg >= 0 ? livein[reg] : !isAssigned(g, arg)))
+        result.emplace_back(op.ValueOrIndex);
+      else
+        result.emplace_back(std::nullopt);
+    }
+
+    return result;
+  }
+
+  // Copy the blocks of g into a new function, with a unique name derived from
+  // the name of g.
+  static WhileFunction &clone(WhileFunction &g)
+  {
+    WhileProgram &p = *g.Program;
+    WhileFunction *f = nullptr;
+    for(unsigned int n = 1; !f; n++)
+    {
+      std::string name = g.Name + "." + std::to_string(n);
+      auto [i, inserted] = p.Functions.try_emplace(name, name,
+                                                   p.FunctionsByIndex.size(),
+                                                   &p);
+      if (inserted)
+        f = &i->second;
+    }
+
+    p.FunctionsByIndex.emplace_back(f);
+    f->Locals = g.Locals;
+    f->Registers = g.Registers;
+    f->NumRegisters = g.NumRegisters;
+    f->FrameSize = g.FrameSize;
+    f->ParameterRegisters = g.ParameterRegisters;
+    f->FrameObjects = g.FrameObjects;
+
+    for(unsigned int idx = 0; idx < g.Body.size(); idx++)
+      f->createBlock();
+
+    for(const WhileBlock *bb : g.Body)
+    {
+      WhileBlock *c = f->Body[bb->Index];
+      for(const WhileInstr *instr : bb->Body)
+      {
+        WhileInstr *ci = c->createInstr(instr->Line, instr->OffsetOnLine,
+                                        instr->Opc, instr->Ops.size());
+        std::copy(instr->Ops.begin(), instr->Ops.end(), ci->Ops.begin());
+        ci->InBounds = instr->InBounds;
+        ci->TailCall = instr->TailCall;
+        c->insert(c->Body.size(), ci);
+      }
+
+      for(unsigned int kind = WFALL_THROUGH; kind <= WBRANCH_TAKEN; kind++)
+        if (bb->Succ[kind])
+          c->addEdge((WhileSuccKind)kind, f->Body[bb->Succ[kind]->Index]);
+    }
+
+    return *f;
+  }
+
+  // Assign the constant arguments of one of the calls to the parameters in a
+  // new entry block, such that branches back to the old entry block do not
+  // reassign them.
+  static void specialize(WhileFunction &f, const Signature &sig,
+                         const WhileInstr &call)
+  {
+    WhileBlock *entry = f.Body.front();
+    WhileBlock *bb = f.createBlockBefore(entry);
+    bb->addEdge(WFALL_THROUGH, entry);
+    bb->Count = entry->Count;
+
+    for(unsigned int arg = 0; arg < sig.size(); arg++)
+    {
+      if (!sig[arg])
+        continue;
+
+      int reg = f.ParameterRegisters[arg];
+      if (reg >= 0)
+      {
+        bb->append(bb->createMove(call, WhileOperand(WREGISTER, reg),
+                                  call.Ops[arg + 2]));
+        continue;
+      }
+
+      WhileInstr *instr = bb->createInstr(call.Line, call.OffsetOnLine,
+                                          WSTORE, 3);
+      instr->Ops[0] = WhileOperand(WFRAMEPOINTER);
+      instr->Ops[1] = WhileOperand(WIMMEDIATE, arg);
+      instr->Ops[2] = call.Ops[arg + 2];
+      bb->append(instr);
+    }
+  }
+
+  // Move a call to another callee, updating the call sites.
+  static void redirect(WhileInstr *call, const WhileFunction &callee)
+  {
+    WhileBlock *bb = call->Block;
+    unsigned int idx = call->Index;
+    bb->erase(idx);
+    call->Ops[0].ValueOrIndex = callee.Index;
+    bb->insert(idx, call);
+  }
+
+  bool run(WhileProgram &p) override
+  {
+    bool changed = false;
+    unsigned int budget = std::max<unsigned int>(MinBudget,
+                                                 countInstructions(p) *
+                                                   MaxGrowth);
+
+    // Clones are added at the end and not considered again.
+    unsigned int numfuns = p.FunctionsByIndex.size();
+    for(unsigned int idx = 0; idx < numfuns; idx++)
+    {
+      WhileFunction &g = *p.FunctionsByIndex[idx];
+      if (g.CallSites.empty() || !accepts(g))
+        continue;
+
+      // Constants passed by all calls are assigned in the function itself,
+      // unless it is entered otherwise.
+      WhileRegisterSet livein = WhileLiveness(g).LiveIn[0];
+      Signature none(g.ParameterRegisters.size());
+      Signature common = none;
+      if (g.Name != "main")
+        common = signature(*g.CallSites.front(), g, livein);
+      for(const WhileInstr *cs : g.CallSites)
+      {
+        Signature sig = signature(*cs, g, livein);
+        for(unsigned int arg = 0; arg < sig.size(); arg++)
+          if (sig[arg] != common[arg])
+            common[arg] = std::nullopt;
+      }
+
+      if (common != none)
+      {
+        specialize(g, common, *g.CallSites.front());
+        livein = WhileLiveness(g).LiveIn[0];
+        changed = true;
+      }
+
+      std::map<Signature, std::vector<WhileInstr*> > groups;
+      for(WhileInstr *cs : g.CallSites)
+        groups[signature(*cs, g, livein)].emplace_back(cs);
+
+      unsigned int gsize = g.size();
+      unsigned long entry = g.Body.front()->Count;
+      for(const auto &[sig, calls] : groups)
+      {
+        if (sig == none || gsize > MaxSize || gsize > budget)
+          continue;
+
+        // Calls that were never executed according to the profile are not
+        // worth the code size.
+        unsigned long count = 0;
+        for(const WhileInstr *cs : calls)
+          count += cs->Block->Count;
+
+        if (p.HasProfile && count == 0)
+          continue;
+
+        WhileFunction &f = clone(g);
+        for(unsigned int b = 0; b < g.Body.size() && entry; b++)
+        {
+          unsigned long c = std::min(g.Body[b]->Count,
+                                     g.Body[b]->Count * count / entry);
+          f.Body[b]->Count = c;
+          g.Body[b]->Count -= c;
+
+          c = std::min(g.Body[b]->TakenCount,
+                       g.Body[b]->TakenCount * count / entry);
+          f.Body[b]->TakenCount = c;
+          g.Body[b]->TakenCount -= c;
+        }
+        entry -= std::min(entry, count);
+
+        for(WhileInstr *cs : calls)
+          redirect(cs, f);
+
+        specialize(f, sig, *calls.front());
+        budget -= gsize;
+        changed = true;
+      }
+    }
+
+    return changed;
+  }
+
+  WhileSpecialization() : WhilePass("specialize",
+                                    "Function specialization on constant "
+                                    "arguments")
+  {
+  }
+};
+
+WhileSpecialization WSPEC;
@@ -0,0 +1,408 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements the strength reduction of induction variables. Basic
+// induction variables are registers whose definitions in a loop all add a
+// constant to them. Derived induction variables multiply a basic induction
+// variable by, or add to it, a loop-invariant value. They are replaced by a new
+// register, initialized in the preheader and incremented right after each
+// definition of the basic induction variable, turning multiplications into
+// additions. When a basic induction variable is otherwise only compared with
+// loop-invariant values and not live after the loop, the comparisons are
+// rewritten to use a derived induction variable (linear-function test
+// replacement), its increments are then removed by dead code elimination.
+// Arithmetic wraps around, test replacement is thus only done when the values
+// compared provably fit, i.e., the induction variable starts from a constant,
+// only grows, and is bounded by the exit test of the loop header.
+
+#include "WhilePass.h"
+#include "WhileLiveness.h"
+#include "WhileLoops.h"
+
+#include <climits>
+#include <map>
+
+struct WhileStrengthReduction : public WhileFunctionPass
+{
+  static bool isCompare(WhileOpcode opc)
+  {
+    return opc >= WEQUAL && opc <= WLESSEQUAL;
+  }
+
+  struct LoopInfo
+  {
+    WhileFunction &F;
+    const WhileLoopForest &LF;
+    const WhileLoop &Loop;
+    const WhileLiveness &WL;
+    WhileBlock *Preheader;
+
+    // Definitions of each register inside of the loop.
+    std::vector<std::vector<WhileInstr*> > Defs;
+
+    // A derived induction variable, computed by Instr as IV Opc Other.
+    struct Derived
+    {
+      WhileInstr *Instr;
+      WhileOpcode Opc;
+      WhileOperand Other;
+    };
+
+    LoopInfo(WhileFunction &f, const WhileLoopForest &lf, const WhileLoop &loop,
+             const WhileLiveness &wl)
+      : F(f), LF(lf), Loop(loop), WL(wl), Preheader(preheader(loop)),
+        Defs(f.NumRegisters)
+    {
+      for(WhileBlock *bb : Loop.Blocks)
+      {
+        for(WhileInstr *instr : bb->Body)
+        {
+          const WhileOperand *def = instr->def();
+          if (def)
+            Defs[def->ValueOrIndex].emplace_back(instr);
+        }
+      }
+    }
+
+    // Registers added by the transformation are not considered invariant.
+    bool isInvariant(const WhileOperand &op) const
+    {
+      return op.isImm() ||
+             (op.Kind == WREGISTER &&
+              (unsigned int)op.ValueOrIndex < Defs.size() &&
+              Defs[op.ValueOrIndex].empty());
+    }
+
+    static bool isReg(const WhileOperand &op, int r)
+    {
+      return op.Kind == WREGISTER && op.ValueOrIndex == r;
+    }
+
+    // The constant added to r by an instruction, if it is an increment.
+    static bool isIncrement(const WhileInstr &instr, int r, int &step)
+    {
+      if ((instr.Opc != WPLUS && instr.Opc != WMINUS) ||
+          instr.Ops[0].ValueOrIndex != r)
+        return false;
+
+      const WhileOperand &a = instr.Ops[1];
+      const WhileOperand &b = instr.Ops[2];
+      if (instr.Opc == WPLUS && isReg(a, r) && b.isImm())
+        step = b.ValueOrIndex;
+      else if (instr.Opc == WPLUS && a.isImm() && isReg(b, r))
+        step = a.ValueOrIndex;
+      else if (instr.Opc == WMINUS && isReg(a, r) && b.isImm())
+        evaluateBinary(WMINUS, 0, b.ValueOrIndex, step);
+      else
+        return false;
+
+      return true;
+    }
+
+    // The constant assigned to r before the loop, searched backwards from the
+    // preheader over blocks with a single predecessor.
+    bool initial(int r, int &value) const
+    {
+      const WhileBlock *bb = Preheader;
+      for(unsigned int n = 0; bb && n < F.Body.size(); n++)
+      {
+        for(unsigned int idx = bb->Body.size(); idx-- > 0; )
+        {
+          const WhileInstr *instr = bb->Body[idx];
+          const WhileOperand *def = instr->def();
+          if (!def || def->ValueOrIndex != r)
+            continue;
+
+          return instr->Opc >= WPLUS && instr->Opc <= WLESSEQUAL &&
+                 instr->Ops[1].isImm() && instr->Ops[2].isImm() &&
+                 evaluateBinary(instr->Opc, instr->Ops[1].ValueOrIndex,
+                                instr->Ops[2].ValueOrIndex, value);
+        }
+
+        bb = bb->Pred.size() == 1 ? bb->Pred.front().Block : nullptr;
+      }
+
+      return false;
+    }
+
+    // The range of values of the basic induction variable r in the loop. The
+    // increments have to be positive and executed at most once per iteration,
+    // the header has to exit the loop unless r is below an immediate bound.
+    bool range(int r, long long &lo, long long &hi) const
+    {
+      long long step = 0;
+      for(const WhileInstr *inc : Defs[r])
+      {
+        int s;
+        isIncrement(*inc, r, s);
+        if (s <= 0 || inc->Block == Loop.Header ||
+            LF.InnermostLoop[inc->Block->Index] != &Loop)
+          return false;
+
+        step += s;
+      }
+
+      const WhileBlock *header = Loop.Header;
+      const WhileInstr *branch = header->Body.empty() ? nullptr :
+                                                         header->Body.back();
+      if (!branch || branch->Opc != WBRANCHZ ||
+          branch->Ops[0].Kind != WREGISTER ||
+          Loop.contains(header->Succ[WBRANCH_TAKEN]))
+        return false;
+
+      const WhileInstr *cmp = nullptr;
+      for(unsigned int idx = branch->Index; idx-- > 0 && !cmp; )
+      {
+        const WhileOperand *def = header->Body[idx]->def();
+        if (def && def->ValueOrIndex == branch->Ops[0].ValueOrIndex)
+          cmp = header->Body[idx];
+      }
+
+      int init;
+      if (!cmp || (cmp->Opc != WLESS && cmp->Opc != WLESSEQUAL) ||
+          !isReg(cmp->Ops[1], r) || !cmp->Ops[2].isImm() || !initial(r, init))
+        return false;
+
+      long long bound = (long long)cmp->Ops[2].ValueOrIndex -
+                        (cmp->Opc == WLESS);
+      lo = init;
+      hi = std::max<long long>(init, bound + step);
+      return hi <= INT_MAX;
+    }
+
+    // Check that replacing the values in [lo, hi] and the bound by their image
+    // under the derived induction variable does not overflow.
+    static bool fits(const Derived &d, long long lo, long long hi,
+                     const WhileOperand &bound)
+    {
+      if (!d.Other.isImm() || !bound.isImm())
+        return false;
+
+      long long c = d.Other.ValueOrIndex;
+      for(long long v : {lo, hi, (long long)bound.ValueOrIndex})
+      {
+        long long image = d.Opc == WMULT ? v * c :
+                          d.Opc == WPLUS ? v + c : v - c;
+        if (image < INT_MIN || image > INT_MAX)
+          return false;
+      }
+
+      return true;
+    }
+
+    bool isBasic(int r) const
+    {
+      int step;
+      for(const WhileInstr *instr : Defs[r])
+        if (!isIncrement(*instr, r, step))
+          return false;
+
+      return !Defs[r].empty();
+    }
+
+    // Emit OpD = A Opc B at the end of the preheader, or fold it.
+    WhileOperand emit(const WhileInstr &at, WhileOpcode opc,
+                      const WhileOperand &a, const WhileOperand &b)
+    {
+      int value;
+      if (a.isImm() && b.isImm() &&
+          evaluateBinary(opc, a.ValueOrIndex, b.ValueOrIndex, value))
+        return WhileOperand(WIMMEDIATE, value);
+
+      unsigned int pos = Preheader->Body.size();
+      if (pos && Preheader->Body.back()->isTerminator())
+        pos--;
+
+      WhileOperand dst(WREGISTER, F.NumRegisters++);
+      insert(Preheader, pos, at, opc, dst, a, b);
+      return dst;
+    }
+
+    static void insert(WhileBlock *bb, unsigned int pos, const WhileInstr &at,
+                       WhileOpcode opc, const WhileOperand &dst,
+                       const WhileOperand &a, const WhileOperand &b)
+    {
+      WhileInstr *instr = bb->createInstr(at.Line, at.OffsetOnLine, opc, 3);
+      instr->Ops[0] = dst;
+      instr->Ops[1] = a;
+      instr->Ops[2] = b;
+      bb->insert(pos, instr);
+    }
+
+    // Replace the derived induction variable by a new register, incremented
+    // after each increment of the basic induction variable r.
+    WhileOperand reduce(int r, const Derived &d)
+    {
+      WhileOperand reg = emit(*d.Instr, d.Opc, WhileOperand(WREGISTER, r),
+                              d.Other);
+
+      std::map<int, WhileOperand> steps;
+      for(WhileInstr *inc : Defs[r])
+      {
+        int step;
+        isIncrement(*inc, r, step);
+        if (d.Opc == WMULT && !steps.count(step))
+          steps.emplace(step, emit(*d.Instr, WMULT, d.Other,
+                                   WhileOperand(WIMMEDIATE, step)));
+        else if (d.Opc != WMULT)
+          steps.emplace(step, WhileOperand(WIMMEDIATE, step));
+
+        insert(inc->Block, inc->Index + 1, *inc, WPLUS, reg, reg,
+               steps.at(step));
+      }
+
+      WhileBlock *bb = d.Instr->Block;
+      bb->replace(d.Instr->Index, bb->createMove(*d.Instr, d.Instr->Ops[0],
+                                                 reg));
+      return reg;
+    }
+
+    bool reduce(int r)
+    {
+      // Classify the uses of r in the loop, besides its increments.
+      std::vector<Derived> derived;
+      std::vector<WhileInstr*> compares;
+      bool removable = true;
+      for(const auto &[from, to] : Loop.Exits)
+        if (WL.LiveIn[to->Index][r])
+          removable = false;
+
+      for(WhileBlock *bb : Loop.Blocks)
+      {
+        for(WhileInstr *instr : bb->Body)
+        {
+          int step;
+          bool uses = false;
+          for(unsigned int idx = 0; idx < instr->Ops.size(); idx++)
+            if (instr->Ops[idx].Kind == WREGISTER &&
+                instr->Ops[idx].ValueOrIndex == r && instr->isUse(idx))
+              uses = true;
+
+          if (!uses || isIncrement(*instr, r, step))
+            continue;
+          else if (!instr->isPure())
+          {
+            removable = false;
+            continue;
+          }
+
+          const WhileOperand &a = instr->Ops[1];
+          const WhileOperand &b = instr->Ops[2];
+          bool first = a.Kind == WREGISTER && a.ValueOrIndex == r;
+          const WhileOperand &other = first ? b : a;
+          bool isDerived =
+            (instr->Opc == WMULT || instr->Opc == WPLUS ||
+             (instr->Opc == WMINUS && first)) &&
+            isInvariant(other);
+
+          if (isDerived)
+            derived.push_back(Derived{instr, instr->Opc, other});
+          else if (isCompare(instr->Opc) && isInvariant(other))
+            compares.emplace_back(instr);
+          else
+            removable = false;
+        }
+      }
+
+      // Test replacement needs a derived induction variable whose order
+      // matches the one of r, i.e., not scaled by a negative or unknown value,
+      // and which does not overflow for the values compared.
+      long long lo, hi;
+      bool bounded = range(r, lo, hi);
+      const Derived *test = nullptr;
+      for(const Derived &d : derived)
+      {
+        bool valid = bounded &&
+                     (d.Opc != WMULT || (d.Other.isImm() &&
+                                         d.Other.ValueOrIndex > 0));
+        for(const WhileInstr *cmp : compares)
+          valid = valid && fits(d, lo, hi, cmp->Ops[isReg(cmp->Ops[1], r) ?
+                                                   2 : 1]);
+
+        if (valid)
+          test = &d;
+      }
+
+      if (compares.size() && !test)
+        removable = false;
+
+      bool changed = false;
+      WhileOperand testreg;
+      for(const Derived &d : derived)
+      {
+        if (d.Opc != WMULT && !removable)
+          continue;
+
+        WhileOperand reg = reduce(r, d);
+        if (&d == test)
+          testreg = reg;
+
+        changed = true;
+      }
+
+      if (!removable)
+        return changed;
+
+      for(WhileInstr *cmp : compares)
+      {
+        unsigned int pos = cmp->Ops[1].Kind == WREGISTER &&
+                           cmp->Ops[1].ValueOrIndex == r ? 1 : 2;
+        cmp->Ops[3 - pos] = emit(*cmp, test->Opc, cmp->Ops[3 - pos],
+                                 test->Other);
+        cmp->Ops[pos] = testreg;
+        F.invalidateCode();
+        changed = true;
+      }
+
+      return changed;
+    }
+  };
+
+  bool run(WhileFunction &f) override
+  {
+    bool changed = insertPreheaders(f);
+
+    // Instructions are only added, the loop forest remains valid, as does the
+    // liveness at the exits for registers that existed before.
+    const WhileLoopForest &LF = f.loops();
+    WhileLiveness WL(f);
+    for(auto l = LF.Loops.rbegin(); l != LF.Loops.rend(); l++)
+    {
+      LoopInfo LI(f, LF, **l, WL);
+      std::vector<int> basic;
+      for(unsigned int r = 0; r < LI.Defs.size(); r++)
+        if (LI.isBasic(r))
+          basic.emplace_back(r);
+
+      for(int r : basic)
+        changed |= LI.reduce(r);
+    }
+
+    return changed;
+  }
+
+  WhileStrengthReduction() : WhileFunctionPass("strength",
+                                               "Strength reduction of "
+                                               "induction variables")
+  {
+  }
+};
+
+WhileStrengthReduction WSR;
@@ -0,0 +1,159 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements the elimination of tail calls, i.e., calls whose result
+// is returned right away. Recursive tail calls are replaced by moves of the
+// arguments to the parameters and a branch back to the beginning of the
+// function, turning the recursion into a loop. Other tail calls are marked, the
+// interpreter then reuses the frame of the caller for the callee. Both require
+// that the address of the caller's frame does not escape, as the frame is
+// overwritten before the callee runs.
+
+#include "WhilePass.h"
+#include "WhileLiveness.h"
+
+#include <algorithm>
+
+struct WhileTailCallElimination : public WhileFunctionPass
+{
+  static WhileInstr *create(const WhileInstr &call, WhileBlock *bb,
+                            WhileOpcode opc, unsigned int numops)
+  {
+    return bb->createInstr(call.Line, call.OffsetOnLine, opc, numops);
+  }
+
+  // Replace a recursive tail call by the assignment of its arguments to the
+  // parameters and a branch to the header. Registers read before being written
+  // are cleared, as they are zero on entry of the function.
+  static void eliminate(WhileFunction &f, WhileInstr *call, WhileBlock *header,
+                        WhileRegisterSet clear)
+  {
+    // The return following the call is removed along with it.
+    WhileBlock *bb = call->Block;
+    bb->erase(call->Index);
+    if (call->Index < bb->Body.size())
+      bb->erase(call->Index);
+    else
+      bb->removeEdge(WFALL_THROUGH);
+
+    // Arguments reading parameters that are assigned before them are saved.
+    const std::vector<int> &params = f.ParameterRegisters;
+    std::vector<WhileOperand> args;
+    for(unsigned int arg = 0; arg < params.size(); arg++)
+    {
+      WhileOperand val = call->Ops[arg + 2];
+      if (val.Kind == WREGISTER &&
+          std::find(params.begin(), params.begin() + arg, val.ValueOrIndex) !=
+            params.begin() + arg)
+      {
+        WhileOperand tmp(WREGISTER, f.NumRegisters++);
+        bb->append(bb->createMove(*call, tmp, val));
+        val = tmp;
+      }
+
+      args.emplace_back(val);
+    }
+
+    for(unsigned int arg = 0; arg < params.size(); arg++)
+    {
+      if (params[arg] >= 0)
+        continue;
+
+      WhileInstr *store = create(*call, bb, WSTORE, 3);
+      store->Ops[0] = WhileOperand(WFRAMEPOINTER);
+      store->Ops[1] = WhileOperand(WIMMEDIATE, arg);
+      store->Ops[2] = args[arg];
+      bb->append(store);
+    }
+
+    for(unsigned int arg = 0; arg < params.size(); arg++)
+    {
+      int reg = params[arg];
+      if (reg < 0)
+        continue;
+
+      clear[reg] = false;
+      if (args[arg].Kind != WREGISTER || args[arg].ValueOrIndex != reg)
+        bb->append(bb->createMove(*call, WhileOperand(WREGISTER, reg),
+                                  args[arg]));
+    }
+
+    for(unsigned int r = 0; r < clear.size(); r++)
+      if (clear[r])
+        bb->append(bb->createMove(*call, WhileOperand(WREGISTER, r),
+                                  WhileOperand(WIMMEDIATE, 0)));
+
+    WhileInstr *branch = create(*call, bb, WBRANCH, 1);
+    branch->Ops[0] = WhileOperand(WBLOCK, header->Index);
+    bb->append(branch);
+    bb->addEdge(WBRANCH_TAKEN, header);
+    bb->TakenCount = bb->Count;
+  }
+
+  bool run(WhileFunction &f) override
+  {
+    bool escapes = f.frameEscapes();
+    bool changed = false;
+    std::vector<WhileInstr*> recursive;
+    for(WhileBlock *bb : f.Body)
+    {
+      for(WhileInstr *instr : bb->Body)
+      {
+        if (instr->Opc != WCALL || instr->Ops[0].ValueOrIndex < 0)
+          continue;
+
+        bool tail = !escapes && instr->inTailPosition();
+        if (tail && instr->Ops[0].ValueOrIndex == (int)f.Index)
+          recursive.emplace_back(instr);
+        else if (instr->TailCall != tail)
+        {
+          instr->TailCall = tail;
+          changed = true;
+        }
+      }
+    }
+
+    if (recursive.empty())
+      return changed;
+
+    // The recursion branches to the original entry block, a new entry block
+    // is placed before it. Its execution count is the number of calls from
+    // outside of the function.
+    WhileRegisterSet clear = WhileLiveness(f).LiveIn[0];
+    WhileBlock *header = f.Body.front();
+    WhileBlock *entry = f.createBlockBefore(header);
+    entry->addEdge(WFALL_THROUGH, header);
+    entry->Count = header->Count;
+    for(WhileInstr *call : recursive)
+    {
+      entry->Count -= std::min(entry->Count, call->Block->Count);
+      eliminate(f, call, header, clear);
+    }
+
+    return true;
+  }
+
+  WhileTailCallElimination() : WhileFunctionPass("tailcall",
+                                                 "Tail-call elimination")
+  {
+  }
+};
+
+WhileTailCallElimination WTCE;
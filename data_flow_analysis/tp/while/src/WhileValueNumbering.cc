@@ -0,0 +1,334 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements dominator-based global value numbering. The blocks are
+// visited in a pre-order traversal of the dominator tree with a scoped table of
+// available expressions, redundant pure instructions and loads are replaced by
+// copies of the register already holding their value.
+//
+// The registers are not in SSA form. A register with a single definition that
+// dominates all its uses holds the same value wherever it is used, all other
+// registers are versioned: a new version starts with each definition and at the
+// beginning of each block with several predecessors. Copies are looked through,
+// i.e., the destination of a copy has the value of its source.
+
+#include "WhilePass.h"
+#include "WhileDominators.h"
+
+#include <optional>
+#include <tuple>
+
+// A data operand, i.e., operand kind, value or register index, and version.
+typedef std::tuple<int, int, unsigned int> WhileValue;
+
+// An operation and its operands.
+typedef std::tuple<int, WhileValue, WhileValue> WhileExpression;
+
+// A register holding the value of an expression, as long as its version does
+// not change.
+struct WhileValueHolder
+{
+  int Register;
+  unsigned int Version;
+};
+
+// A register known to be a copy of a source register, while the versions of
+// both registers do not change.
+struct WhileCopyOf
+{
+  int Source;
+  unsigned int SourceVersion;
+  unsigned int Version;
+};
+
+typedef std::map<WhileExpression, WhileValueHolder> WhileLoadTable;
+
+struct WhileValueTable
+{
+  const WhileFunction &F;
+  const WhileDominatorTree &DT;
+
+  std::vector<bool> Stable;
+  std::vector<unsigned int> Version;
+  std::vector<std::optional<WhileCopyOf> > Copies;
+  unsigned int NextVersion = 1;
+
+  // Available pure expressions, the undo log restores the table when leaving
+  // a subtree of the dominator tree.
+  std::map<WhileExpression, WhileValueHolder> Available;
+  std::vector<std::pair<WhileExpression,
+                        std::optional<WhileValueHolder> > > Undo;
+
+  explicit WhileValueTable(const WhileFunction &f)
+    : F(f), DT(f.dominators()), Stable(f.NumRegisters), Version(f.NumRegisters),
+      Copies(f.NumRegisters)
+  {
+    std::vector<unsigned int> numDefs(f.NumRegisters);
+    std::vector<const WhileInstr*> defs(f.NumRegisters);
+    for(const WhileBlock *bb : f.Body)
+    {
+      for(const WhileInstr *instr : bb->Body)
+      {
+        const WhileOperand *def = instr->def();
+        if (def && def->Kind == WREGISTER)
+        {
+          numDefs[def->ValueOrIndex]++;
+          defs[def->ValueOrIndex] = instr;
+        }
+      }
+    }
+
+    for(unsigned int r = 0; r < f.NumRegisters; r++)
+      Stable[r] = numDefs[r] == 1;
+
+    for(const WhileBlock *bb : f.Body)
+    {
+      for(const WhileInstr *instr : bb->Body)
+      {
+        for(unsigned int idx = 0; idx < instr->Ops.size(); idx++)
+        {
+          const WhileOperand &op = instr->Ops[idx];
+          if (op.Kind == WREGISTER && instr->isUse(idx) &&
+              Stable[op.ValueOrIndex] &&
+              !DT.dominates(*defs[op.ValueOrIndex], *instr))
+            Stable[op.ValueOrIndex] = false;
+        }
+      }
+    }
+  }
+
+  WhileValue value(int r) const
+  {
+    const std::optional<WhileCopyOf> &copy = Copies[r];
+    if (copy && copy->Version == Version[r] &&
+        copy->SourceVersion == Version[copy->Source])
+      return {WREGISTER, copy->Source, copy->SourceVersion};
+
+    return {WREGISTER, r, Version[r]};
+  }
+
+  WhileValue value(const WhileOperand &op) const
+  {
+    switch (op.Kind)
+    {
+      case WREGISTER:
+        return value(op.ValueOrIndex);
+      case WIMMEDIATE:
+        return {WIMMEDIATE, op.ValueOrIndex, 0};
+      case WFRAMEPOINTER:
+        return {WFRAMEPOINTER, 0, 0};
+
+      case WBLOCK:
+      case WFUNCTION:
+      case WUNKNOWN:
+        assert("Operand is not a data value.");
+    }
+    abort();
+  }
+
+  WhileExpression expression(const WhileInstr &instr) const
+  {
+    WhileValue a = value(instr.Ops[1]);
+    WhileValue b = value(instr.Ops[2]);
+    bool commutative = instr.Opc == WPLUS || instr.Opc == WMULT ||
+                       instr.Opc == WEQUAL || instr.Opc == WUNEQUAL;
+    if (commutative && b < a)
+      std::swap(a, b);
+
+    return {instr.Opc, a, b};
+  }
+
+  bool isValid(const WhileValueHolder &holder) const
+  {
+    return Version[holder.Register] == holder.Version;
+  }
+
+  void define(const WhileInstr &instr)
+  {
+    const WhileOperand *def = instr.def();
+    if (!def)
+      return;
+
+    int r = def->ValueOrIndex;
+    WhileValue source;
+    if (instr.isCopy())
+      source = value(instr.Ops[2]);
+
+    if (!Stable[r])
+      Version[r] = NextVersion++;
+
+    if (instr.isCopy() && std::get<1>(source) != r)
+      Copies[r] = WhileCopyOf{std::get<1>(source), std::get<2>(source),
+                              Version[r]};
+    else
+      Copies[r].reset();
+  }
+
+  void makeAvailable(const WhileExpression &e, int r)
+  {
+    auto old = Available.find(e);
+    if (old == Available.end())
+      Undo.emplace_back(e, std::nullopt);
+    else
+      Undo.emplace_back(e, old->second);
+
+    Available[e] = WhileValueHolder{r, Version[r]};
+  }
+
+  // Check whether a store to [base + offs] may modify the value of a load.
+  bool mayAlias(const WhileValue &base, const WhileValue &offs,
+                const WhileExpression &load) const
+  {
+    const auto &[opc, lbase, loffs] = load;
+    bool immOffs = std::get<0>(offs) == WIMMEDIATE &&
+                   std::get<0>(loffs) == WIMMEDIATE;
+    if (!immOffs)
+      return true;
+    else if (base == lbase)
+      return offs == loffs;
+
+    // Absolute addresses of globals are below all frames.
+    auto isGlobal = [this](const WhileValue &b, const WhileValue &o) {
+      int addr = std::get<1>(b) + std::get<1>(o);
+      return std::get<0>(b) == WIMMEDIATE && addr >= 0 &&
+             addr < (int)F.Program->DataSize;
+    };
+    auto isFrame = [](const WhileValue &b, const WhileValue &o) {
+      return std::get<0>(b) == WFRAMEPOINTER && std::get<1>(o) >= 0;
+    };
+
+    if ((isGlobal(base, offs) && isFrame(lbase, loffs)) ||
+        (isFrame(base, offs) && isGlobal(lbase, loffs)))
+      return false;
+    else if (std::get<0>(base) == WIMMEDIATE &&
+             std::get<0>(lbase) == WIMMEDIATE)
+      return std::get<1>(base) + std::get<1>(offs) ==
+             std::get<1>(lbase) + std::get<1>(loffs);
+
+    return true;
+  }
+
+  // Replace the instruction at position idx by a copy of the holder.
+  static void replaceByCopy(WhileBlock &bb, unsigned int idx, int holder)
+  {
+    const WhileInstr &instr = *bb.Body[idx];
+    bb.replace(idx, bb.createMove(instr, instr.Ops[0],
+                                  WhileOperand(WREGISTER, holder)));
+  }
+
+  bool visit(WhileBlock &bb, WhileLoadTable loads)
+  {
+    bool changed = false;
+    unsigned int scope = Undo.size();
+
+    // Registers keep their values when entering a block from its only
+    // predecessor.
+    if (bb.Pred.size() != 1)
+    {
+      for(unsigned int r = 0; r < F.NumRegisters; r++)
+        if (!Stable[r])
+          Version[r] = NextVersion++;
+    }
+
+    for(unsigned int idx = 0; idx < bb.Body.size(); idx++)
+    {
+      WhileInstr &instr = *bb.Body[idx];
+      if (instr.isPure() || instr.Opc == WLOAD)
+      {
+        WhileExpression e = expression(instr);
+        auto &table = instr.Opc == WLOAD ? loads : Available;
+        auto holder = table.find(e);
+        if (holder != table.end() && isValid(holder->second))
+        {
+          replaceByCopy(bb, idx, holder->second.Register);
+          define(*bb.Body[idx]);
+          changed = true;
+          continue;
+        }
+
+        define(instr);
+        int r = instr.Ops[0].ValueOrIndex;
+        if (instr.Opc == WLOAD)
+          loads[e] = WhileValueHolder{r, Version[r]};
+        else
+          makeAvailable(e, r);
+      }
+      else if (instr.Opc == WSTORE)
+      {
+        WhileValue base = value(instr.Ops[0]);
+        WhileValue offs = value(instr.Ops[1]);
+        for(auto l = loads.begin(); l != loads.end(); )
+        {
+          if (mayAlias(base, offs, l->first))
+            l = loads.erase(l);
+          else
+            l++;
+        }
+      }
+      else if (instr.Opc == WCALL)
+      {
+        // The callee may modify any memory cell.
+        loads.clear();
+        define(instr);
+      }
+      else
+        define(instr);
+    }
+
+    // Memory is unchanged when entering a successor reached from this block
+    // only.
+    std::vector<unsigned int> exit = Version;
+    for(WhileBlock *child : DT.Children[bb.Index])
+    {
+      bool single = child->Pred.size() == 1;
+      Version = exit;
+      changed |= visit(*child, single ? loads : WhileLoadTable());
+    }
+
+    while (Undo.size() > scope)
+    {
+      auto &[e, old] = Undo.back();
+      if (old)
+        Available[e] = *old;
+      else
+        Available.erase(e);
+
+      Undo.pop_back();
+    }
+
+    return changed;
+  }
+};
+
+struct WhileValueNumbering : public WhileFunctionPass
+{
+  bool run(WhileFunction &f) override
+  {
+    WhileValueTable WVT(f);
+    return WVT.visit(*f.Body.front(), WhileLoadTable());
+  }
+
+  WhileValueNumbering() : WhileFunctionPass("gvn",
+                                            "Global value numbering")
+  {
+  }
+};
+
+WhileValueNumbering WGVN;
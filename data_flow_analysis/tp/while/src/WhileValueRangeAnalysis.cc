@@ -173,6 +173,7 @@ struct WhileConstantRange : public WhileDataFlowAnalysis<WhileValueRangeDomain>
       case WBRANCH:
       case WRETURN:
       case WSTORE:
+      case WPHI:
         // do not write symbolic registers
         break;
 
@@ -0,0 +1,435 @@
+// This file is part of While, an educational programming language and program
+// analysis framework.
+//
+//   Copyright 2023 Florian Brandner
+//
+// While is free software: you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the Free Software
+// Foundation, either version 3 of the License, or (at your option) any later
+// version.
+//
+// While is distributed in the hope that it will be useful, but WITHOUT ANY
+// WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+// A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// While. If not, see <https://www.gnu.org/licenses/>.
+//
+// Contact: florian.brandner@telecom-paris.fr
+//
+
+// This file implements a consistency check of the control-flow graphs of While
+// programs, which is run by the pass manager after each transformation.
+
+#include "WhilePass.h"
+#include "WhileDefUse.h"
+
+#include <algorithm>
+
+class WhileVerifier
+{
+  const WhileProgram &Program;
+  std::ostream &S;
+  bool Valid = true;
+
+  std::ostream &error(const WhileFunction &f)
+  {
+    Valid = false;
+    return S << f.Name << ": ";
+  }
+
+  std::ostream &error(const WhileBlock &bb)
+  {
+    Valid = false;
+    return S << bb.Function->Name << "::BB" << bb.Index << ": ";
+  }
+
+  std::ostream &error(const WhileInstr &i)
+  {
+    Valid = false;
+    return S << i.Block->Function->Name << "::BB" << i.Block->Index << "::"
+             << i.Index << ": ";
+  }
+
+  void verifyRegister(const WhileInstr &i, unsigned int idx)
+  {
+    const WhileOperand &op = i.Ops[idx];
+    if (op.Kind != WREGISTER)
+      error(i) << "operand " << idx << " is not a register.\n";
+  }
+
+  void verifyData(const WhileInstr &i, unsigned int idx)
+  {
+    const WhileOperand &op = i.Ops[idx];
+    if (!op.isData())
+      error(i) << "operand " << idx << " is not a data value.\n";
+  }
+
+  void verifyBlock(const WhileInstr &i, unsigned int idx)
+  {
+    const WhileOperand &op = i.Ops[idx];
+    if (!op.isBlock() || op.ValueOrIndex < 0 ||
+        (unsigned int)op.ValueOrIndex >= i.Block->Function->Body.size())
+      error(i) << "operand " << idx << " is not a valid block.\n";
+  }
+
+  void verifyOperands(const WhileInstr &i)
+  {
+    const WhileFunction &f = *i.Block->Function;
+    unsigned int numops = i.Ops.size();
+
+    switch (i.Opc)
+    {
+      case WCALL:
+      {
+        if (numops < 2)
+        {
+          error(i) << "call without function or result operand.\n";
+          return;
+        }
+
+        const WhileOperand &fun = i.Ops[0];
+        if (!fun.isFunction() ||
+            (fun.ValueOrIndex >= 0 &&
+             (unsigned int)fun.ValueOrIndex >= Program.FunctionsByIndex.size()))
+          error(i) << "call to an invalid function.\n";
+        else if (fun.ValueOrIndex >= 0 &&
+                 Program.FunctionsByIndex[fun.ValueOrIndex]->
+                   ParameterRegisters.size() != numops - 2)
+          error(i) << "call with wrong number of arguments.\n";
+
+        verifyRegister(i, 1);
+        for(unsigned int idx = 2; idx < numops; idx++)
+          verifyData(i, idx);
+        break;
+      }
+      case WLOAD:
+      case WPLUS:
+      case WMINUS:
+      case WMULT:
+      case WDIV:
+      case WEQUAL:
+      case WUNEQUAL:
+      case WLESS:
+      case WLESSEQUAL:
+        if (numops != 3)
+        {
+          error(i) << "expected 3 operands, got " << numops << ".\n";
+          return;
+        }
+        verifyRegister(i, 0);
+        verifyData(i, 1);
+        verifyData(i, 2);
+        break;
+      case WSTORE:
+        if (numops != 3)
+        {
+          error(i) << "expected 3 operands, got " << numops << ".\n";
+          return;
+        }
+        verifyData(i, 0);
+        verifyData(i, 1);
+        verifyData(i, 2);
+        break;
+      case WBRANCHZ:
+        if (numops != 2)
+        {
+          error(i) << "expected 2 operands, got " << numops << ".\n";
+          return;
+        }
+        verifyData(i, 0);
+        verifyBlock(i, 1);
+        break;
+      case WBRANCH:
+        if (numops != 1)
+        {
+          error(i) << "expected 1 operand, got " << numops << ".\n";
+          return;
+        }
+        verifyBlock(i, 0);
+        break;
+      case WRETURN:
+        if (numops != 1)
+        {
+          error(i) << "expected 1 operand, got " << numops << ".\n";
+          return;
+        }
+        verifyData(i, 0);
+        break;
+      case WPHI:
+        if (numops != i.Block->Pred.size() + 1)
+        {
+          error(i) << "phi with " << numops - 1 << " operands for "
+                   << i.Block->Pred.size() << " predecessors.\n";
+          return;
+        }
+        verifyRegister(i, 0);
+        for(unsigned int idx = 1; idx < numops; idx++)
+          verifyData(i, idx);
+        break;
+    }
+
+    for(const WhileOperand &op : i.Ops)
+    {
+      if (op.Kind == WREGISTER &&
+          (op.ValueOrIndex < 0 ||
+           (unsigned int)op.ValueOrIndex >= f.NumRegisters))
+        error(i) << "register R" << op.ValueOrIndex << " out of range.\n";
+    }
+  }
+
+  // Check that the successors match the terminator of the block.
+  void verifyTerminator(const WhileBlock &bb)
+  {
+    const WhileFunction &f = *bb.Function;
+    const WhileInstr *last = bb.Body.empty() ? nullptr : bb.Body.back();
+    WhileOpcode opc = last ? last->Opc : WPLUS;
+
+    const WhileBlock *target = nullptr;
+    if (opc == WBRANCH || opc == WBRANCHZ)
+    {
+      const WhileOperand &op = last->Ops[opc == WBRANCH ? 0 : 1];
+      if (op.isBlock() && op.ValueOrIndex >= 0 &&
+          (unsigned int)op.ValueOrIndex < f.Body.size())
+        target = f.Body[op.ValueOrIndex];
+    }
+
+    switch (opc)
+    {
+      case WBRANCH:
+        if (bb.Succ[WFALL_THROUGH])
+          error(bb) << "unconditional branch with fall-through successor.\n";
+        if (bb.Succ[WBRANCH_TAKEN] != target)
+          error(bb) << "branch target does not match taken successor.\n";
+        break;
+      case WBRANCHZ:
+        if (!bb.Succ[WFALL_THROUGH])
+          error(bb) << "conditional branch without fall-through successor.\n";
+        if (bb.Succ[WBRANCH_TAKEN] != target)
+          error(bb) << "branch target does not match taken successor.\n";
+        break;
+      case WRETURN:
+        if (bb.Succ[WFALL_THROUGH] || bb.Succ[WBRANCH_TAKEN])
+          error(bb) << "return with successors.\n";
+        break;
+      default:
+        if (bb.Succ[WBRANCH_TAKEN])
+          error(bb) << "taken successor without branch.\n";
+        if (!bb.Succ[WFALL_THROUGH])
+          error(bb) << "falling off the end of the function.\n";
+    }
+
+    for(const WhileBlock *succ : bb.Succ)
+    {
+      if (succ && succ->Function != &f)
+        error(bb) << "successor in another function.\n";
+    }
+  }
+
+  // Check that each successor edge appears exactly once in the predecessor
+  // list of its target and vice versa.
+  void verifyEdges(const WhileBlock &bb)
+  {
+    for(unsigned int kind = WFALL_THROUGH; kind <= WBRANCH_TAKEN; kind++)
+    {
+      const WhileBlock *succ = bb.Succ[kind];
+      if (!succ)
+        continue;
+
+      auto n = std::count_if(succ->Pred.begin(), succ->Pred.end(),
+                             [&](const WhileEdge &e) {
+                               return e.Block == &bb && e.Kind == kind;
+                             });
+      if (n != 1)
+        error(bb) << "successor BB" << succ->Index << " lists this block "
+                  << n << " time(s) as predecessor.\n";
+    }
+
+    for(const auto &[pred, kind] : bb.Pred)
+    {
+      if (!pred || pred->Succ[kind] != &bb)
+        error(bb) << "predecessor edge without matching successor.\n";
+    }
+  }
+
+  void verifyCallSites(const WhileFunction &f)
+  {
+    for(const WhileInstr *cs : f.CallSites)
+    {
+      const WhileBlock *bb = cs->Block;
+      if (!bb || cs->Index >= bb->Body.size() || bb->Body[cs->Index] != cs ||
+          bb->Function->Body.size() <= bb->Index ||
+          bb->Function->Body[bb->Index] != bb)
+        error(f) << "call site not part of the program.\n";
+      else if (cs->Opc != WCALL || cs->Ops[0].ValueOrIndex != (int)f.Index)
+        error(f) << "call site does not call the function.\n";
+    }
+  }
+
+  // Canonical forms of the chains, independent of the order of the updates.
+  typedef std::vector<std::pair<const WhileInstr*, unsigned int> > UseList;
+
+  static UseList canonical(const std::vector<WhileUse> &uses)
+  {
+    UseList result;
+    for(const WhileUse &u : uses)
+      result.emplace_back(u.Instr, u.Operand);
+
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+  static std::vector<std::pair<unsigned int, std::vector<const WhileInstr*> > >
+  canonical(const WhileDefUse &DU, const WhileInstr &i)
+  {
+    std::vector<std::pair<unsigned int, std::vector<const WhileInstr*> > >
+      result;
+    for(auto u = DU.usesBegin(i); u != DU.usesEnd(i); u++)
+    {
+      std::vector<const WhileInstr*> defs(u->Defs.begin(), u->Defs.end());
+      std::sort(defs.begin(), defs.end());
+      result.emplace_back(u->Use.Operand, defs);
+    }
+
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+  // Check that the cached def-use chains, when considered up-to-date, match
+  // the chains computed from scratch.
+  void verifyDefUse(const WhileFunction &f)
+  {
+    if (!f.DefUseChains || f.DefUseChains->Version != f.CodeVersion)
+      return;
+
+    const WhileDefUse &cached = *f.DefUseChains;
+    WhileDefUse DU(f);
+    if (cached.Instrs.size() != DU.Instrs.size())
+    {
+      error(f) << "def-use chains out of date.\n";
+      return;
+    }
+
+    for(const auto &[i, info] : DU.Instrs)
+    {
+      auto c = cached.Instrs.find(i);
+      if (c == cached.Instrs.end() || c->second.Def != info.Def ||
+          canonical(c->second.Reached) != canonical(info.Reached) ||
+          canonical(cached, *i) != canonical(DU, *i))
+        error(*i) << "def-use chains out of date.\n";
+    }
+
+    for(unsigned int r = 0; r < f.NumRegisters; r++)
+      if (r >= cached.EntryUses.size() ||
+          canonical(cached.EntryUses[r]) != canonical(DU.EntryUses[r]))
+        error(f) << "def-use chains of R" << r << " out of date.\n";
+  }
+
+  // Check that calls marked as tail calls remain in tail position, and that
+  // the callee cannot access the caller's frame.
+  void verifyTailCalls(const WhileFunction &f)
+  {
+    bool escapes = f.frameEscapes();
+    for(const WhileBlock *bb : f.Body)
+    {
+      for(const WhileInstr *i : bb->Body)
+      {
+        if (!i->TailCall)
+          continue;
+
+        if (!i->inTailPosition())
+          error(*i) << "tail call not in tail position.\n";
+        else if (escapes)
+          error(*i) << "tail call from a function whose frame escapes.\n";
+      }
+    }
+  }
+
+public:
+  WhileVerifier(const WhileProgram &p, std::ostream &s)
+    : Program(p), S(s)
+  {
+  }
+
+  bool verify()
+  {
+    for(unsigned int idx = 0; idx < Program.FunctionsByIndex.size(); idx++)
+    {
+      const WhileFunction &f = *Program.FunctionsByIndex[idx];
+      if (f.Index != idx || f.Program != &Program)
+        error(f) << "inconsistent function index.\n";
+
+      for(int r : f.ParameterRegisters)
+        if (r >= (int)f.NumRegisters)
+          error(f) << "parameter register R" << r << " out of range.\n";
+
+      if (f.Body.empty())
+      {
+        error(f) << "function without blocks.\n";
+        continue;
+      }
+
+      for(unsigned int bbidx = 0; bbidx < f.Body.size(); bbidx++)
+      {
+        const WhileBlock &bb = *f.Body[bbidx];
+        if (bb.Index != bbidx || bb.Function != &f)
+          error(bb) << "inconsistent block index.\n";
+
+        for(unsigned int iidx = 0; iidx < bb.Phis.size(); iidx++)
+        {
+          const WhileInstr &i = *bb.Phis[iidx];
+          if (i.Index != iidx || i.Block != &bb)
+            error(i) << "inconsistent phi index.\n";
+          else if (i.Opc != WPHI)
+            error(i) << "instruction among the phis of the block.\n";
+          else
+            verifyOperands(i);
+        }
+
+        for(unsigned int iidx = 0; iidx < bb.Body.size(); iidx++)
+        {
+          const WhileInstr &i = *bb.Body[iidx];
+          if (i.Index != iidx || i.Block != &bb)
+            error(i) << "inconsistent instruction index.\n";
+
+          if (i.Opc == WPHI)
+            error(i) << "phi in the body of the block.\n";
+
+          if (i.isTerminator() && iidx + 1 != bb.Body.size())
+            error(i) << "terminator in the middle of a block.\n";
+
+          verifyOperands(i);
+
+          if (i.Opc == WCALL && i.Ops.size() && i.Ops[0].isFunction() &&
+              i.Ops[0].ValueOrIndex >= 0 &&
+              (unsigned int)i.Ops[0].ValueOrIndex <
+                Program.FunctionsByIndex.size())
+          {
+            const auto &cs =
+              Program.FunctionsByIndex[i.Ops[0].ValueOrIndex]->CallSites;
+            if (std::find(cs.begin(), cs.end(), &i) == cs.end())
+              error(i) << "call is not a call site of its callee.\n";
+          }
+        }
+
+        verifyTerminator(bb);
+        verifyEdges(bb);
+      }
+
+      verifyCallSites(f);
+      if (Valid)
+      {
+        verifyTailCalls(f);
+        verifyDefUse(f);
+      }
+    }
+
+    return Valid;
+  }
+};
+
+bool verifyProgram(const WhileProgram &p, std::ostream &s)
+{
+  WhileVerifier v(p, s);
+  return v.verify();
+}
@@ -0,0 +1,40 @@
+# This file is part of While, an educational programming language and program
+# analysis framework.
+#
+#   Copyright 2023 Florian Brandner
+#
+# While is free software: you can redistribute it and/or modify it under the
+# terms of the GNU General Public License as published by the Free Software
+# Foundation, either version 3 of the License, or (at your option) any later
+# version.
+#
+# While is distributed in the hope that it will be useful, but WITHOUT ANY
+# WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+# A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along with
+# While. If not, see <https://www.gnu.org/licenses/>.
+#
+# Contact: florian.brandner@telecom-paris.fr
+#
+
+# Run the program INPUT with WHILE_RUN, once unoptimized and once with the
+# command-line options OPTIONS, and compare the output and exit status.
+#
+#   cmake -DWHILE_RUN=<while-run> -DINPUT=<input.whl> -DOPTIONS=<options>
+#         -P compare.cmake
+
+execute_process(COMMAND ${WHILE_RUN} -O0 ${INPUT}
+                OUTPUT_VARIABLE expected
+                RESULT_VARIABLE expectedstatus)
+
+separate_arguments(options UNIX_COMMAND "${OPTIONS}")
+execute_process(COMMAND ${WHILE_RUN} ${options} ${INPUT}
+                OUTPUT_VARIABLE actual
+                RESULT_VARIABLE actualstatus)
+
+if(NOT actual STREQUAL expected OR NOT actualstatus STREQUAL expectedstatus)
+  message(FATAL_ERROR "Mismatch for '${OPTIONS}':\n"
+                      "-O0 (exit ${expectedstatus}):\n${expected}\n"
+                      "${OPTIONS} (exit ${actualstatus}):\n${actual}")
+endif()